@@ -4,12 +4,13 @@ extern void start(void);
 extern void intr_softerr(void);
 extern void intr_syscall(void);
 extern void intr_serintr(void);
+extern void intr_timintr(void);
 
 void (*vectors[])(void) = {
 	start,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
 	intr_syscall,intr_softerr,intr_softerr,intr_softerr,
 	NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
-	NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
+	NULL,NULL,NULL,NULL,intr_timintr,NULL,NULL,NULL,
 	NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
 	NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
 	NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,
@@ -6,20 +6,26 @@
 /* コンソール・ドライバの使用開始をコンソール・ドライバに依頼する */
 static void send_use(int index)
 {
-  char *p;
-  p = kz_kmalloc(3);
-  p[0] = '0';
-  p[1] = CONSDRV_CMD_USE;
-  p[2] = '0' + index;
-  kz_send(MSGBOX_ID_CONSOUTPUT, 3, p);
+  char buf[3];
+  buf[0] = '0';
+  buf[1] = CONSDRV_CMD_USE;
+  buf[2] = '0' + index;
+  kz_send_copy(MSGBOX_ID_CONSOUTPUT, 3, buf); /* 短いのでコピーして送る */
 }
 
 /* コンソールへの文字列出力をコンソール・ドライバに依頼する */
 static void send_write(char *str)
 {
-  char *p;
+  char *p, buf[KZ_MSG_INLINE_SIZE];
   int len;
   len = strlen(str);
+  if (len + 2 <= KZ_MSG_INLINE_SIZE) { /* 短い文字列はコピーして送る */
+    buf[0] = '0';
+    buf[1] = CONSDRV_CMD_WRITE;
+    memcpy(&buf[2], str, len);
+    kz_send_copy(MSGBOX_ID_CONSOUTPUT, len + 2, buf);
+    return;
+  }
   p = kz_kmalloc(len + 2);
   p[0] = '0';
   p[1] = CONSDRV_CMD_WRITE;
@@ -27,6 +33,74 @@ static void send_write(char *str)
   kz_send(MSGBOX_ID_CONSOUTPUT, len + 2, p);
 }
 
+/* 数値を16進数で出力する(lib.c の putxval() と同様) */
+static void send_xval(unsigned long value, int column)
+{
+  char buf[9];
+  char *p;
+
+  p = buf + sizeof(buf) - 1;
+  *(p--) = '\0';
+
+  if (!value && !column)
+    column++;
+
+  while (value || column) {
+    *(p--) = "0123456789abcdef"[value & 0xf];
+    value >>= 4;
+    if (column) column--;
+  }
+
+  send_write(p + 1);
+}
+
+/* 各スレッドのスタック使用量を出力する */
+static void stack_command(void)
+{
+  static kz_stackinfo_t info[THREAD_NUM];
+  kz_stackinfo_t *ip;
+  int i, n;
+
+  /*
+   * kz_stackinfo_t のサイズは２の累乗でないので，インデックスでなく
+   * ポインタで参照する．(インデックス計算に32ビットの乗算が使われるため)
+   */
+  n = kz_getstack(info, THREAD_NUM);
+  for (i = 0, ip = info; i < n; i++, ip++) {
+    send_write(ip->name);
+    send_write(" size:");
+    send_xval(ip->size, 4);
+    if (ip->used >= 0) {
+      send_write(" used:");
+      send_xval(ip->used, 4);
+      send_write(" free:");
+      send_xval(ip->size - ip->used, 4);
+    }
+    send_write("\n");
+  }
+}
+
+/* 各メッセージ・ボックスの格納数と上限，最大格納数を出力する */
+static void msgbox_command(void)
+{
+  kz_msgboxinfo_t info;
+  int id;
+
+  for (id = 0; id < MSGBOX_NUM; id++) {
+    if (kz_msgbox_getinfo(id, &info) < 0) /* 未作成 */
+      continue;
+    send_write("msgbox ");
+    send_xval(id, 2);
+    send_write(" count:");
+    send_xval(info.count, 2);
+    send_write(" limit:");
+    send_xval(info.limit, 2);
+    send_write(" max:");
+    send_xval(info.maxcount, 2);
+    send_write("\n");
+  }
+}
+
 int command_main(int argc, char *argv[])
 {
   char *p;
@@ -44,6 +118,14 @@ int command_main(int argc, char *argv[])
     if (!strncmp(p, "echo", 4)) { /* echoコマンド */
       send_write(p + 4); /* echoに続く文字列を出力する */
       send_write("\n");
+    } else if (!strncmp(p, "stack", 5)) { /* stackコマンド */
+      stack_command();
+    } else if (!strncmp(p, "msgbox", 6)) { /* msgboxコマンド */
+      msgbox_command();
+#ifdef KZ_BENCH
+    } else if (!strncmp(p, "bench", 5)) { /* benchコマンド */
+      kz_run(test12_main, "test12", 2, 0, 0x200, 0, NULL);
+#endif
     } else {
       send_write("unknown.\n");
     }
@@ -92,7 +92,8 @@ static int consdrv_intrproc(struct consreg *cons)
 	 */
 	p = kx_kmalloc(CONS_BUFFER_SIZE);
 	memcpy(p, cons->recv_buf, cons->recv_len);
-	kx_send(MSGBOX_ID_CONSINPUT, cons->recv_len, p);
+	if (kx_send(MSGBOX_ID_CONSINPUT, cons->recv_len, p) < 0)
+	  kx_kmfree(p); /* メッセージ・ボックスが満杯なので捨てる */
 	cons->recv_len = 0;
       }
     }
@@ -138,6 +139,8 @@ static int consdrv_init(void)
 static int consdrv_command(struct consreg *cons, kz_thread_id_t id,
 			   int index, int size, char *command)
 {
+  int i, len;
+
   switch (command[0]) {
   case CONSDRV_CMD_USE: /* コンソール・ドライバの使用開始 */
     cons->id = id;
@@ -155,9 +158,27 @@ static int consdrv_command(struct consreg *cons, kz_thread_id_t id,
      * send_string()では送信バッファを操作しており再入不可なので，
      * 排他のために割込み禁止にして呼び出す．
      */
-    INTR_DISABLE;
-    send_string(cons, command + 1, size - 1); /* 文字列の送信 */
-    INTR_ENABLE;
+    command++;
+    size--;
+    while (size > 0) {
+      INTR_DISABLE;
+      /*
+       * 送信バッファに入るぶんだけ書き込む．
+       * (\n は \r\n に変換されるので，２文字ぶんとして数える)
+       */
+      len = cons->send_len;
+      for (i = 0; i < size; i++) {
+	len += (command[i] == '\n') ? 2 : 1;
+	if (len > CONS_BUFFER_SIZE)
+	  break;
+      }
+      send_string(cons, command, i); /* 文字列の送信 */
+      INTR_ENABLE;
+      command += i;
+      size -= i;
+      if (size > 0)
+	kz_sleep(1); /* 送信バッファが空くのを待つ */
+    }
     break;
 
   default:
@@ -171,16 +192,22 @@ int consdrv_main(int argc, char *argv[])
 {
   int size, index;
   kz_thread_id_t id;
-  char *p;
+  char *p, buf[KZ_MSG_INLINE_SIZE];
 
   consdrv_init();
   kz_setintr(SOFTVEC_TYPE_SERINTR, consdrv_intr); /* 割込みハンドラ設定 */
 
   while (1) {
-    id = kz_recv(MSGBOX_ID_CONSOUTPUT, &size, &p);
+    /*
+     * 短い要求はコピー送信されて buf に入る．
+     * kz_send() で送られた要求ならば，p がそのバッファに置き換わる．
+     */
+    p = buf;
+    id = kz_recv_copy(MSGBOX_ID_CONSOUTPUT, &size, &p);
     index = p[0] - '0';
     consdrv_command(&consreg[index], id, index, size - 1, p + 1);
-    kz_kmfree(p);
+    if (p != buf)
+      kz_kmfree(p);
   }
 
   return 0;
@@ -4,18 +4,100 @@
 #define NULL ((void *)0)
 #define SERIAL_DEFAULT_DEVICE 1
 
+/*
+ * スレッド数と優先度の段階数(Makefileで指定する)
+ * 優先度は最大64段階で，最も低い優先度はアイドル・スレッドが使う．
+ */
+#ifndef THREAD_NUM
+#define THREAD_NUM 6
+#endif
+#ifndef PRIORITY_NUM
+#define PRIORITY_NUM 16
+#endif
+
+#define THREAD_NAME_SIZE 15
+#define KZ_MSG_INLINE_SIZE 16 /* kz_send_copy() で送れるメッセージの最大サイズ */
+#define KZ_RECV_ANY_MAX 4 /* kz_recv_any() で同時に待てるメッセージ・ボックスの数 */
+#define KZ_MSG_PRI_NUM 4     /* メッセージの優先度の段階数(0が最高．８まで) */
+#define KZ_MSG_PRI_DEFAULT 2 /* kz_send() などで送ったメッセージの優先度 */
+
+/* 直接呼び出し版(KZ_DIRECTCALL)は，パラメータ格納域渡しのABIを使う */
+#if defined(KZ_DIRECTCALL) && !defined(KZ_SYSCALL_PARAM_ABI)
+#define KZ_SYSCALL_PARAM_ABI
+#endif
+
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned long uint32;
 
 typedef uint32 kz_thread_id_t;
+#define KZ_RECV_FAIL ((kz_thread_id_t)-1) /* 受信できなかった(タイムアウト等) */
 typedef int (*kz_func_t)(int argc,char *argv[]);
 typedef void (*kz_handler_t)(void);
 
+/* カーネルの統計情報 */
+typedef struct {
+  uint32 ticks;   /* 起動からのティック数 */
+  uint32 skipped; /* ティックレス・アイドルで省略したティック割込みの数 */
+  uint32 dispatched; /* 割込み出口でスレッドを切替えた回数 */
+  uint32 fastpath;   /* 割込み出口で切替えずにそのまま戻った回数 */
+} kz_stat_t;
+
+/* カーネル情報ブロック(KZ_INFO で参照する) */
+typedef struct {
+  kz_thread_id_t id; /* 実行中のスレッド */
+  int priority;      /* 実行中のスレッドの優先度 */
+  kz_stat_t stat;    /* 統計情報 */
+} kz_info_t;
+
+/* スレッドのスタック使用量 */
+typedef struct {
+  char name[THREAD_NAME_SIZE + 1];
+  int size; /* スタックのサイズ */
+  int used; /* 最大使用量(KZ_STACK_CHECK が無効ならば -1) */
+} kz_stackinfo_t;
+
+/* メッセージ・ボックスの格納状況 */
+typedef struct {
+  int count;    /* 格納しているメッセージ数 */
+  int limit;    /* 格納できるメッセージ数の上限 */
+  int maxcount; /* 格納したメッセージ数の最大値 */
+} kz_msgboxinfo_t;
+
 typedef enum {
   MSGBOX_ID_CONSINPUT = 0,
   MSGBOX_ID_CONSOUTPUT,
   MSGBOX_ID_NUM
 } kz_msgbox_id_t;
 
+/*
+ * kz_msgbox_create() で作成するものも含めたメッセージ・ボックスの総数．
+ * 作成したメッセージ・ボックスには MSGBOX_ID_NUM 以降のIDが割り当てられる．
+ */
+#ifndef MSGBOX_NUM
+#define MSGBOX_NUM 6
+#endif
+
+typedef enum {
+  MUTEX_ID_MUTEX1 = 0,
+  MUTEX_ID_MUTEX2,
+  MUTEX_ID_NUM
+} kz_mutex_id_t;
+
+typedef enum {
+  SEM_ID_SEM1 = 0,
+  SEM_ID_SEM2,
+  SEM_ID_NUM
+} kz_sem_id_t;
+
+typedef enum {
+  FLAG_ID_FLAG1 = 0,
+  FLAG_ID_NUM
+} kz_flag_id_t;
+
+/* kz_flag_wait() の待ちモード */
+#define KZ_FLAG_OR    0        /* いずれかのビットがセットされたら起床 */
+#define KZ_FLAG_AND   (1 << 0) /* すべてのビットがセットされたら起床 */
+#define KZ_FLAG_CLEAR (1 << 1) /* 起床時に待っていたビットをクリアする */
+
 #endif
@@ -11,6 +11,8 @@ typedef void (*softvec_handler_t)(softvec_type_t type ,unsigned long sp);
 
 #define INTR_ENABLE     asm volatile ("andc.b #0x3f,ccr")
 #define INTR_DISABLE    asm volatile ("orc.b #0xc0,ccr")
+#define INTR_SAVE(ccr)    asm volatile ("stc ccr,%0" : "=r"(ccr))
+#define INTR_RESTORE(ccr) asm volatile ("ldc %0,ccr" : : "r"(ccr))
 
 int softvec_init(void);
 
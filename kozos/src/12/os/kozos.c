@@ -3,26 +3,63 @@
 #include "intr.h"
 #include "interrupt.h"
 #include "syscall.h"
+#include "timer.h"
 #include "lib.h"
 
-#define THREAD_NUM 6
-#define PRIORITY_NUM 16
-#define THREAD_NAME_SIZE 15
+#define TICK_TIMER_INDEX 0 /* ティック割込みに使うタイマのチャネル */
+#define TICK_MSEC 1        /* ティックの周期(ミリ秒) */
+
+#define IDLE_PRIORITY (PRIORITY_NUM - 1) /* アイドル・スレッドの優先度 */
+
+#if PRIORITY_NUM > 64
+#error "PRIORITY_NUM must be 64 or less."
+#endif
 
 /* スレッド・コンテキスト */
 typedef struct _kz_context {
   uint32 sp; /* スタック・ポインタ */
 } kz_context;
 
+struct _kz_thread;
+struct _kz_mutex;
+struct _kz_msgbox;
+
+/*
+ * 受信待ちノード(受信待ちするメッセージ・ボックスごとに１つ使う)
+ * prevp で前のノードの next(先頭ならば receivers)を指しておき，
+ * 受信待ちのリストを辿らずに外せるようにする．
+ * TCB の中で配列にするので，サイズは２の累乗(16バイト)にしておくこと．
+ */
+typedef struct _kz_waitnode {
+  struct _kz_waitnode *next;
+  struct _kz_waitnode **prevp;
+  struct _kz_thread *thread; /* 受信待ちしているスレッド */
+  struct _kz_msgbox *msgbox; /* 受信待ちしているメッセージ・ボックス */
+} kz_waitnode;
+
 /* タスク・コントロール・ブロック(TCB) */
 typedef struct _kz_thread
 {
     struct _kz_thread *next;
     char name[THREAD_NAME_SIZE + 1]; /* スレッド名 */
-    int priority;
+    int priority;      /* 実効優先度(優先度継承を含む) */
+    int base_priority; /* kz_run()/kz_chpri() で設定された本来の優先度 */
+    int quantum; /* タイム・スライス(ティック数．0ならばスライスしない) */
+    int slice;   /* タイム・スライスの残り */
     char *stack; /* スタック */
+    int stacksize; /* スタックのサイズ */
     uint32 flags;
 #define KZ_THREAD_FLAG_READY (1 << 0)
+#define KZ_THREAD_FLAG_SLEEP (1 << 1) /* スリープ・キューに接続中 */
+#define KZ_THREAD_FLAG_RECVCOPY (1 << 2) /* kz_recv_copy() で受信待ち中 */
+#define KZ_THREAD_FLAG_RECVTMO  (1 << 3) /* kz_recv_timeout() で受信待ち中 */
+#define KZ_THREAD_FLAG_SENDCOPY (1 << 4) /* kz_send_copy() で送信待ち中 */
+#define KZ_THREAD_FLAG_RECVANY  (1 << 5) /* kz_recv_any() で受信待ち中 */
+#define KZ_THREAD_FLAG_CALLWAIT (1 << 6) /* kz_call() で返信待ち中 */
+#define KZ_THREAD_FLAG_NOWAIT   (1 << 7) /* kz_batch() の実行中(待ちに入らない) */
+#define KZ_THREAD_FLAG_SENDPRI  (1 << 8) /* kz_send_pri() で送信待ち中 */
+#define KZ_THREAD_FLAG_WAKEUP   (1 << 9) /* kz_sleep() で起床待ち中 */
+#define KZ_THREAD_FLAG_CALLRECV (1 << 10) /* kz_call() のメッセージが受信済み */
     struct
     {                   /* スレッドのスタート・アップ(thread_init())に渡すパラメータ */
         kz_func_t func; /* スレッドのメイン関数 */
@@ -34,12 +71,33 @@ typedef struct _kz_thread
     { /* システム・コール用バッファ */
         kz_syscall_type_t type;
         kz_syscall_param_t *param;
+#ifndef KZ_SYSCALL_PARAM_ABI
+        int pending;              /* 戻り値を er0 に書き戻す必要がある */
+        kz_syscall_param_t regs;  /* レジスタで渡された引数の展開先 */
+#endif
     } syscall;
 
+    struct
+    { /* スリープ・キュー用 */
+        struct _kz_thread *next;
+        int delta; /* 直前のスレッドからの差分ティック数 */
+    } sleep;
+
+    struct _kz_mutex *mutex;      /* 所有しているミューテックスのリスト */
+    struct _kz_mutex *wait_mutex; /* ロック待ちしているミューテックス */
+    struct _kz_msgbox *wait_msgbox; /* 満杯のため送信待ちしているメッセージ・ボックス */
+    struct _kz_thread **wait_que; /* 待っているセマフォかイベント・フラグの待ちキュー */
+    kz_waitnode recvwait[KZ_RECV_ANY_MAX]; /* 受信待ちノード */
+    int recvwait_num; /* 接続中の受信待ちノードの数(0ならば受信待ちでない) */
+
     kz_context context; /* コンテキスト情報 */
 } kz_thread;
 
-/* メッセージ・バッファ */
+/*
+ * メッセージ・バッファ
+ * メッセージ・ボックスの数だけ RAM を使うので，フラグを１つにまとめて
+ * 32バイトに収めておく．
+ */
 typedef struct _kz_msgbuf {
   struct _kz_msgbuf *next;
   kz_thread *sender; /* メッセージを送信したスレッド */
@@ -47,13 +105,27 @@ typedef struct _kz_msgbuf {
     int size;
     char *p;
   } param;
+  int flags;
+#define KZ_MSGBUF_FLAG_COPIED (1 << 0) /* kz_send_copy() で data にコピーした */
+#define KZ_MSGBUF_FLAG_CALL   (1 << 1) /* kz_call() で送信した */
+  char data[KZ_MSG_INLINE_SIZE];
 } kz_msgbuf;
 
 /* メッセージ・ボックス */
 typedef struct _kz_msgbox {
-  kz_thread *receiver; /* 受信待ち状態のスレッド */
-  kz_msgbuf *head;
-  kz_msgbuf *tail;
+  kz_waitnode *receivers; /* 受信待ちノード(スレッドの優先度順) */
+  struct { /* メッセージの優先度ごとのキュー */
+    kz_msgbuf *head;
+    kz_msgbuf *tail;
+  } que[KZ_MSG_PRI_NUM];
+  kz_msgbuf *freebufs; /* 空きメッセージ・バッファのリスト */
+  kz_thread *senders; /* 満杯のため送信待ち状態のスレッド(優先度順) */
+  int count;    /* 格納しているメッセージ数 */
+  int limit;    /* 格納できるメッセージ数の上限 */
+  int maxcount; /* count の最大値 */
+  int used;     /* 使用中(作成済み)のメッセージ・ボックス */
+  int quemap;   /* メッセージのある que のビットマップ(0ならば空) */
+  int dummy[5];
 
   /*
    * H8は16ビットCPUなので，32ビット整数に対しての乗算命令が無い．よって
@@ -62,11 +134,33 @@ typedef struct _kz_msgbox {
    * ある．(２の累乗ならばシフト演算が利用されるので問題は出ない)
    * 対策として，サイズが２の累乗になるようにダミー・メンバで調整する．
    * 他構造体で同様のエラーが出た場合には，同様の対処をすること．
+   * (現在はダミー・メンバで64バイトにしている)
    */
-  long dummy[1];
 } kz_msgbox;
 
 
+/* ミューテックス */
+typedef struct _kz_mutex {
+  kz_thread *owner;       /* ロックを所有しているスレッド */
+  kz_thread *waiters;     /* ロック待ちスレッド(優先度順) */
+  struct _kz_mutex *next; /* 所有スレッドの持つミューテックスのリスト */
+  long dummy[1];          /* kz_msgbox と同様に，サイズを２の累乗にする */
+} kz_mutex;
+
+/* セマフォ */
+typedef struct _kz_sem {
+  int count;          /* 資源の数 */
+  kz_thread *waiters; /* 獲得待ちスレッド(優先度順) */
+  int dummy[1];       /* kz_msgbox と同様に，サイズを２の累乗にする */
+} kz_sem;
+
+/* イベント・フラグ */
+typedef struct _kz_flag {
+  uint16 pattern;     /* フラグのビット・パターン */
+  kz_thread *waiters; /* 待ちスレッド(優先度順) */
+  int dummy[1];       /* kz_msgbox と同様に，サイズを２の累乗にする */
+} kz_flag;
+
 /* スレッドのレディー・キュー */
 static struct
 {
@@ -74,13 +168,158 @@ static struct
     kz_thread *tail;
 } readyque[PRIORITY_NUM];
 
+/*
+ * レディー・キューのビットマップ
+ * 優先度を8個ずつのグループに分け，グループ内のビットマップ(map)と，
+ * 空でないグループを示すビットマップ(group)の２段で管理する．
+ * H8はバレル・シフタを持たず可変長シフトはループになるため，
+ * ビット位置の計算はすべて表引きで行う．
+ */
+#define READYQUE_GROUP_NUM ((PRIORITY_NUM + 7) / 8)
+
+static struct {
+  uint8 group;
+  uint8 map[READYQUE_GROUP_NUM];
+} readyque_bitmap;
+
+/* ビット番号→ビット値 */
+static const uint8 readyque_bit[8] = {
+  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+};
+
+/* 値→セットされている最下位ビットの番号(find first set) */
+static const uint8 readyque_ffs[256] = {
+  0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+  4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+};
+
 static kz_thread *current; /* カレント・スレッド */
 static kz_thread threads[THREAD_NUM]; /* タスク・コントロール・ブロック */
+static kz_thread *freethreads; /* 未使用のTCBのリスト(nextで接続) */
+
+/*
+ * 解放済みスタック領域
+ * 終了したスレッドのスタックは，領域の先頭にこの構造体を置いて
+ * アドレス順のリストに繋ぎ，次のスレッド生成時に再利用する．
+ */
+typedef struct _kz_stack_block {
+  struct _kz_stack_block *next;
+  int size;
+} kz_stack_block;
+
+#define STACK_SPLIT_MIN 0x40 /* これ未満の余りは分割せずに付けて渡す */
+
+/*
+ * 割込みスタックは _intrstack から同じ領域を下位に向かって伸びるので，
+ * スレッドのスタックはその手前までにする．
+ */
+#ifndef INTR_STACK_SIZE
+#define INTR_STACK_SIZE 0x100
+#endif
+
+#ifdef KZ_STACK_CHECK
+/*
+ * スタック使用量の計測
+ * スタックを所定のパターンで埋めておき，書き換えられずに残っている
+ * 部分の大きさから最大使用量を求める．
+ */
+#define STACK_PATTERN 0xa5
+#define STACK_PATTERN_WORD 0xa5a5a5a5
+#endif
+
+static char *stack_top; /* まだ一度も使われていない領域の先頭 */
+static kz_stack_block *freestacks; /* 解放済みスタックのリスト */
 static kz_handler_t handlers[SOFTVEC_TYPE_NUM]; /* 割込みハンドラ */
-static kz_msgbox msgboxes[MSGBOX_ID_NUM]; /* メッセージ・ボックス */
+static kz_msgbox msgboxes[MSGBOX_NUM]; /* メッセージ・ボックス */
+
+/*
+ * メッセージ・バッファ
+ * メッセージ・ボックスごとに MSGBUF_NUM 個ずつ静的に確保しておき，
+ * 送信のたびに動的メモリを獲得しないようにする．
+ * (MSGBOX_NUM * MSGBUF_NUM * 32 バイトの RAM を使う．満杯のときの送信は
+ * kz_send() ならば受信されるまで待つので，少なめにしておく)
+ */
+#ifndef MSGBUF_NUM
+#define MSGBUF_NUM 4
+#endif
+static kz_msgbuf msgbufs[MSGBOX_NUM * MSGBUF_NUM];
+static kz_mutex mutexes[MUTEX_ID_NUM]; /* ミューテックス */
+static kz_sem sems[SEM_ID_NUM]; /* セマフォ */
+static kz_flag eventflags[FLAG_ID_NUM]; /* イベント・フラグ */
+
+/*
+ * スリープ・キュー
+ * 起床時刻順に並べ，各スレッドには直前のスレッドとの差分ティック数を
+ * 持たせる．これによりティックごとの処理は先頭の減算だけで済む．
+ */
+static kz_thread *sleepque;
+
+/*
+ * カーネル情報ブロック
+ * 実行中のスレッドと統計情報(ティック数を含む)を置き，スレッドからは
+ * KZ_INFO で読み出せるようにする．実行中のスレッドの情報はカーネルから
+ * 抜けるたびに更新する．
+ */
+kz_info_t kzinfo;
+
+#ifdef KZ_TICKLESS
+/*
+ * ティックレス・アイドル
+ * アイドル中はタイマの周期を次の起床時刻まで延ばし，途中のティック割込みを
+ * 省略する．アイドルから抜けるときに経過したティックをまとめて処理する．
+ */
+/*
+ * H8には32ビットの乗除算命令が無く，-nostdlib なので libgcc のヘルパも
+ * リンクされない．周期の計算は16ビットの範囲で行う．
+ */
+#define TICK_COUNT ((uint16)((uint32)TICK_MSEC * TIMER_COUNT_PER_MSEC))
+#define TICKLESS_MAX (TIMER_MSEC_MAX / TICK_MSEC)
+
+static int tickless_ticks;     /* アイドル中に設定した周期(ティック数) */
+static kz_thread *idlethread;  /* アイドル・スレッド(kz_start() で起動したもの) */
+#endif
 
 void dispatch(kz_context *context);
 
+/* レディー・キューのビットマップ操作 */
+static void readyque_bitmap_set(int priority)
+{
+  int g = priority >> 3;
+  readyque_bitmap.map[g] |= readyque_bit[priority & 7];
+  readyque_bitmap.group  |= readyque_bit[g];
+}
+
+static void readyque_bitmap_clear(int priority)
+{
+  int g = priority >> 3;
+  readyque_bitmap.map[g] &= ~readyque_bit[priority & 7];
+  if (readyque_bitmap.map[g] == 0)
+    readyque_bitmap.group &= ~readyque_bit[g];
+}
+
+/* 最も優先度の高い(値の小さい)空でないレディー・キューを得る */
+static int readyque_bitmap_top(void)
+{
+  int g;
+  if (readyque_bitmap.group == 0)
+    return -1;
+  g = readyque_ffs[readyque_bitmap.group];
+  return (g << 3) + readyque_ffs[readyque_bitmap.map[g]];
+}
 
 static int getcurrent(void){
     if(current == NULL){
@@ -94,6 +333,7 @@ static int getcurrent(void){
     readyque[current->priority].head = current->next;
     if(readyque[current->priority].head == NULL){
         readyque[current->priority].tail = NULL;
+        readyque_bitmap_clear(current->priority);
     }
     current->flags &= ~KZ_THREAD_FLAG_READY;
     current->next = NULL;
@@ -115,13 +355,324 @@ static int putcurrent(void){
     }
     else{
         readyque[current->priority].head = current;
+        readyque_bitmap_set(current->priority);
     }
     readyque[current->priority].tail = current;
     current->flags |= KZ_THREAD_FLAG_READY;
+    current->slice = current->quantum; /* 末尾に回るたびにスライスを補充する */
 
     return 0;
 }
 
+/*
+ * スレッドをレディー・キューの先頭に接続する
+ * (同じ優先度の他のスレッドよりも先に実行させる場合に使う)
+ */
+static void readyque_push(kz_thread *thp){
+    if(readyque[thp->priority].head == NULL){
+        readyque[thp->priority].tail = thp;
+        readyque_bitmap_set(thp->priority);
+    }
+    thp->next = readyque[thp->priority].head;
+    readyque[thp->priority].head = thp;
+    thp->flags |= KZ_THREAD_FLAG_READY;
+    thp->slice = thp->quantum;
+}
+
+/* 任意のスレッドをレディー・キューから外す */
+static void readyque_remove(kz_thread *thp){
+    kz_thread **thpp, *prev = NULL;
+
+    for(thpp = &readyque[thp->priority].head; *thpp != thp; thpp = &(*thpp)->next){
+        prev = *thpp;
+    }
+    *thpp = thp->next;
+    if(readyque[thp->priority].tail == thp){
+        readyque[thp->priority].tail = prev;
+    }
+    if(readyque[thp->priority].head == NULL){
+        readyque_bitmap_clear(thp->priority);
+    }
+    thp->next = NULL;
+    thp->flags &= ~KZ_THREAD_FLAG_READY;
+}
+
+/* 優先度順の待ちキューに接続する(同じ優先度の中では到着順) */
+static void waitque_insert(kz_thread **quep, kz_thread *thp){
+    for(; *quep; quep = &(*quep)->next){
+        if(thp->priority < (*quep)->priority){
+            break;
+        }
+    }
+    thp->next = *quep;
+    *quep = thp;
+}
+
+static void waitque_remove(kz_thread **quep, kz_thread *thp){
+    for(; *quep; quep = &(*quep)->next){
+        if(*quep == thp){
+            *quep = thp->next;
+            break;
+        }
+    }
+    thp->next = NULL;
+}
+
+/* メッセージ・ボックスの受信待ちノードを優先度順に接続する */
+static void recvwait_insert(kz_thread *thp, kz_msgbox *mboxp){
+    kz_waitnode *np = &thp->recvwait[thp->recvwait_num++];
+    kz_waitnode **quep;
+
+    np->thread = thp;
+    np->msgbox = mboxp;
+    for(quep = &mboxp->receivers; *quep; quep = &(*quep)->next){
+        if(thp->priority < (*quep)->thread->priority){
+            break;
+        }
+    }
+    np->next = *quep;
+    np->prevp = quep;
+    if(*quep){
+        (*quep)->prevp = &np->next;
+    }
+    *quep = np;
+}
+
+/*
+ * スレッドの受信待ちノードを，すべてのメッセージ・ボックスから外す
+ * 各ノードは prevp で直接外せるので，待っているボックスの数に比例する．
+ * (他のスレッドの受信待ちの数には依存しない)
+ */
+static void recvwait_remove(kz_thread *thp){
+    kz_waitnode *np;
+    int i;
+
+    for(i = 0; i < thp->recvwait_num; i++){
+        np = &thp->recvwait[i];
+        *np->prevp = np->next;
+        if(np->next){
+            np->next->prevp = np->prevp;
+        }
+        np->next = NULL;
+        np->prevp = NULL;
+    }
+    thp->recvwait_num = 0;
+}
+
+/*
+ * スレッドの実効優先度を変更する
+ * レディー状態ならば新しい優先度のレディー・キューに繋ぎ直し，
+ * 待ち状態ならば待っているキュー内の位置を直す．
+ */
+static void thread_setpri(kz_thread *thp, int priority){
+    kz_thread *curthp = current;
+    int i, n;
+
+    if(thp->priority == priority){
+        return;
+    }
+
+    if(thp->flags & KZ_THREAD_FLAG_READY){
+        readyque_remove(thp);
+        thp->priority = priority;
+        current = thp;
+        putcurrent();
+        current = curthp;
+    }
+    else{
+        thp->priority = priority;
+        if(thp->wait_mutex){
+            waitque_remove(&thp->wait_mutex->waiters, thp);
+            waitque_insert(&thp->wait_mutex->waiters, thp);
+        }
+        if(thp->wait_msgbox){
+            waitque_remove(&thp->wait_msgbox->senders, thp);
+            waitque_insert(&thp->wait_msgbox->senders, thp);
+        }
+        if(thp->wait_que){
+            waitque_remove(thp->wait_que, thp);
+            waitque_insert(thp->wait_que, thp);
+        }
+        if(thp->recvwait_num){
+            n = thp->recvwait_num;
+            recvwait_remove(thp);
+            for(i = 0; i < n; i++){
+                recvwait_insert(thp, thp->recvwait[i].msgbox);
+            }
+        }
+    }
+}
+
+/* 所有しているミューテックスの待ちスレッドを考慮した実効優先度を求める */
+static int mutex_priority(kz_thread *thp){
+    kz_mutex *mp;
+    int priority = thp->base_priority;
+
+    for(mp = thp->mutex; mp; mp = mp->next){
+        if(mp->waiters && mp->waiters->priority < priority){
+            priority = mp->waiters->priority;
+        }
+    }
+    return priority;
+}
+
+/*
+ * 優先度継承
+ * 待ちスレッドの優先度を所有スレッドに継承させる．所有スレッドが
+ * さらに別のミューテックスを待っているならば，その所有者へたどっていく．
+ */
+static void mutex_inherit(kz_mutex *mp){
+    kz_thread *thp;
+
+    while((thp = mp->owner) && mp->waiters->priority < thp->priority){
+        thread_setpri(thp, mp->waiters->priority);
+        if((mp = thp->wait_mutex) == NULL){
+            break;
+        }
+    }
+}
+
+/*
+ * ミューテックスを current から先頭の待ちスレッドに引き渡す
+ * (current はレディー・キューから外されていること)
+ */
+static void mutex_release(kz_mutex *mp){
+    kz_mutex **mpp;
+    kz_thread *thp;
+
+    for(mpp = &current->mutex; *mpp; mpp = &(*mpp)->next){
+        if(*mpp == mp){
+            *mpp = mp->next;
+            break;
+        }
+    }
+    mp->next = NULL;
+    current->priority = mutex_priority(current); /* 継承した優先度を戻す */
+
+    thp = mp->waiters;
+    mp->owner = thp;
+    if(thp == NULL){
+        return;
+    }
+
+    waitque_remove(&mp->waiters, thp);
+    thp->wait_mutex = NULL;
+    mp->next = thp->mutex;
+    thp->mutex = mp;
+    thp->priority = mutex_priority(thp);
+}
+
+/*
+ * スタックの獲得
+ * 解放済みの領域から最適(best-fit)なものを探し，無ければ未使用の領域から
+ * 切り出す．余りが大きい場合は上位側を使い，下位側を解放済みのまま残す．
+ * 付けて渡した余りのぶん *sizep を更新する．
+ */
+static char *stack_alloc(int *sizep)
+{
+  kz_stack_block *bp, **bpp, **best = NULL;
+  int size = (*sizep + 3) & ~3;
+  char *p;
+  extern char intrstack;
+
+  for (bpp = &freestacks; *bpp; bpp = &(*bpp)->next) {
+    if ((*bpp)->size >= size && (!best || (*bpp)->size < (*best)->size))
+      best = bpp;
+  }
+
+  if (best) {
+    bp = *best;
+    if (bp->size - size >= STACK_SPLIT_MIN) {
+      bp->size -= size;
+      p = (char *)bp + bp->size;
+    } else {
+      *best = bp->next;
+      size = bp->size;
+      p = (char *)bp;
+    }
+    /* 初期フレームは thread_run() で書き込むので，クリアは不要 */
+#ifdef KZ_STACK_CHECK
+    memset(p, STACK_PATTERN, size);
+#endif
+    *sizep = size;
+    return p;
+  }
+
+  if (stack_top + size > &intrstack - INTR_STACK_SIZE)
+    return NULL;
+  p = stack_top;
+  stack_top += size;
+#ifdef KZ_STACK_CHECK
+  memset(p, STACK_PATTERN, size);
+#else
+  memset(p, 0, size);
+#endif
+  *sizep = size;
+  return p;
+}
+
+#ifdef KZ_STACK_CHECK
+/* 一度も使われていないスタックの大きさ(余裕)を求める */
+static int stack_margin(kz_thread *thp)
+{
+  unsigned char *p = (unsigned char *)(thp->stack - thp->stacksize);
+  int margin;
+
+  for (margin = 0; margin < thp->stacksize; margin++) {
+    if (p[margin] != STACK_PATTERN)
+      break;
+  }
+  return margin;
+}
+
+/* スタック溢れの判定(スタックの底のパターンが壊れていれば溢れている) */
+static int stack_is_overflow(kz_thread *thp)
+{
+  char *bottom = thp->stack - thp->stacksize;
+
+  if ((char *)thp->context.sp < bottom)
+    return 1;
+  return (*(uint32 *)bottom != STACK_PATTERN_WORD);
+}
+#endif
+
+/* スタックの解放(隣接する解放済み領域とは結合する) */
+static void stack_free(char *p, int size)
+{
+  kz_stack_block *bp = (kz_stack_block *)p, *prev = NULL, *next, **bpp;
+
+  for (next = freestacks; next && (char *)next < p; next = next->next)
+    prev = next;
+
+  /* 未使用領域の末尾に接していれば，未使用領域に戻す */
+  if (p + size == stack_top) {
+    stack_top = p;
+    if (prev && (char *)prev + prev->size == stack_top) {
+      stack_top = (char *)prev;
+      for (bpp = &freestacks; *bpp != prev; bpp = &(*bpp)->next)
+        ;
+      *bpp = NULL;
+    }
+    return;
+  }
+
+  bp->size = size;
+  bp->next = next;
+  if (next && p + size == (char *)next) { /* 後ろの領域と結合 */
+    bp->size += next->size;
+    bp->next = next->next;
+  }
+
+  if (prev && (char *)prev + prev->size == p) { /* 前の領域と結合 */
+    prev->size += bp->size;
+    prev->next = bp->next;
+  } else if (prev) {
+    prev->next = bp;
+  } else {
+    freestacks = bp;
+  }
+}
+
 static void thread_end(void){
     kz_exit();
 }
@@ -131,23 +682,24 @@ static void thread_init(kz_thread *thp){
     thread_end();
 }
 
-static kz_thread_id_t thread_run(kz_func_t func,char *name,int priority,int stacksize,int argc,char *argv[]){
-    int i;
+static kz_thread_id_t thread_run(kz_func_t func,char *name,int priority,int quantum,int stacksize,int argc,char *argv[]){
     kz_thread *thp;
     uint32 *sp;
-    extern char userstack;
-    static char *thread_stack = &userstack;
+    char *stack;
 
-    for(i=0;i<THREAD_NUM;i++){
-        thp = &threads[i];
-        if(!thp->init.func){
-            /* 空 */
-            break;
-        }
+    /* 未使用のTCBをリストの先頭から取り出す */
+    thp = freethreads;
+    if(thp == NULL){
+        putcurrent(); /* 生成に失敗しても呼び出し元はブロックさせない */
+        return -1;
     }
-    if(i == THREAD_NUM){
+
+    stack = stack_alloc(&stacksize);
+    if(stack == NULL){
+        putcurrent();
         return -1;
     }
+    freethreads = thp->next;
 
     memset(thp,0,sizeof(*thp));
 
@@ -156,15 +708,15 @@ static kz_thread_id_t thread_run(kz_func_t func,char *name,int priority,int stac
 
     thp->next = NULL;
     thp->priority = priority;
+    thp->base_priority = priority;
+    thp->quantum = (quantum > 0) ? (quantum + TICK_MSEC - 1) / TICK_MSEC : 0;
     thp->flags = 0;
     thp->init.func = func;
     thp->init.argc = argc;
     thp->init.argv = argv;
 
-    memset(thread_stack,0,stacksize);
-    thread_stack+= stacksize;
-
-    thp->stack = thread_stack;
+    thp->stack = stack + stacksize;
+    thp->stacksize = stacksize;
 
     sp = (uint32 *)thp->stack;
     *(--sp) = (uint32)thread_end;
@@ -191,9 +743,36 @@ static kz_thread_id_t thread_run(kz_func_t func,char *name,int priority,int stac
 }
 
 static int thread_exit(void){
+    kz_thread *thp = current;
+    kz_thread *next;
+
+#ifndef KZ_EXIT_QUIET
     puts(current->name);
     puts("EXIT.\n");
+#endif
+
+    /* 所有していたミューテックスは待ちスレッドに引き渡す */
+    while(thp->mutex){
+        current = thp;
+        next = thp->mutex->waiters;
+        mutex_release(thp->mutex);
+        if(next){
+            current = next;
+            putcurrent();
+        }
+    }
+    current = thp;
+
+    /*
+     * スタックを解放する．システム・コールは割込みスタック上で
+     * 処理されているので，ここで解放しても問題は無い．
+     */
+    stack_free(current->stack - current->stacksize, current->stacksize);
+
+    /* TCBを未使用のリストに戻す */
     memset(current,0,sizeof(*current));
+    current->next = freethreads;
+    freethreads = current;
     return 0;
 }
 
@@ -202,15 +781,93 @@ static int thread_wait(void){
     return 0;
 }
 
-static int thread_sleep(void){
+/* スリープ・キューに接続する */
+static void sleepque_insert(kz_thread *thp, int delta)
+{
+  kz_thread **thpp;
+
+  for (thpp = &sleepque; *thpp; thpp = &(*thpp)->sleep.next) {
+    if (delta < (*thpp)->sleep.delta)
+      break;
+    delta -= (*thpp)->sleep.delta;
+  }
+  if (*thpp)
+    (*thpp)->sleep.delta -= delta;
+
+  thp->sleep.next = *thpp;
+  thp->sleep.delta = delta;
+  thp->flags |= KZ_THREAD_FLAG_SLEEP;
+  *thpp = thp;
+}
+
+/* スリープ・キューから外す(タイムアウト前に起床された場合) */
+static void sleepque_remove(kz_thread *thp)
+{
+  kz_thread **thpp;
+
+  for (thpp = &sleepque; *thpp; thpp = &(*thpp)->sleep.next) {
+    if (*thpp == thp) {
+      *thpp = thp->sleep.next;
+      if (*thpp)
+        (*thpp)->sleep.delta += thp->sleep.delta;
+      break;
+    }
+  }
+  thp->sleep.next = NULL;
+  thp->flags &= ~KZ_THREAD_FLAG_SLEEP;
+}
+
+/*
+ * システム・コールの処理(kz_sleep():スレッドのスリープ)
+ * msec が正ならば，その時間の経過後に起床する．
+ * 0以下ならば kz_wakeup() で起こされるまでスリープする．
+ */
+static int thread_sleep(int msec){
+    current->flags |= KZ_THREAD_FLAG_WAKEUP;
+    if(msec > 0){
+        sleepque_insert(current, (msec + TICK_MSEC - 1) / TICK_MSEC);
+    }
     return 0;
 }
 
+/* 受信待ちのタイムアウト(kz_recv_timeout() の待ちを解除する) */
+static void msg_timeout(kz_thread *thp)
+{
+  recvwait_remove(thp);
+  thp->flags &= ~(KZ_THREAD_FLAG_RECVCOPY | KZ_THREAD_FLAG_RECVTMO);
+  thp->syscall.param->un.recv_timeout.ret = KZ_RECV_FAIL;
+}
+
+/*
+ * システム・コールの処理(kz_wakeup():スレッドの起床)
+ * 起こせるのは kz_sleep() とタイムアウト付きの受信で待っているスレッド
+ * だけで，それ以外は -1 を返す．ミューテックスやセマフォなどの待ちキューは
+ * レディー・キューと同じ next で繋いでいるので，そのままレディーにすると
+ * 両方のキューが壊れる．
+ */
 static int thread_wakeup(kz_thread_id_t id){
+    kz_thread *thp = (kz_thread *)id;
+
     putcurrent();
 
-    current = (kz_thread *)id;
+    if(thp->flags & KZ_THREAD_FLAG_WAKEUP){
+        thp->flags &= ~KZ_THREAD_FLAG_WAKEUP;
+        if(thp->flags & KZ_THREAD_FLAG_SLEEP){
+            sleepque_remove(thp);
+        }
+    }
+    else if(thp->flags & KZ_THREAD_FLAG_RECVTMO){
+        /* タイムアウト付き受信は，受信待ちノードも外して中断させる */
+        if(thp->flags & KZ_THREAD_FLAG_SLEEP){
+            sleepque_remove(thp);
+        }
+        msg_timeout(thp);
+    }
+    else{
+        return -1;
+    }
 
+    current = thp;
     putcurrent();
     return 0;
 }
@@ -221,14 +878,63 @@ static kz_thread_id_t thread_getid(void){
 }
 
 static int thread_chpri(int priority){
-    int old = current->priority;
+    int old = current->base_priority;
     if(priority >= 0){
-        current->priority = priority;
+        current->base_priority = priority;
+        current->priority = mutex_priority(current);
     }
     putcurrent();
     return old;
 }
 
+/* システム・コールの処理(kz_mutex_lock():ミューテックスのロック) */
+static int thread_mutex_lock(kz_mutex_id_t id)
+{
+  kz_mutex *mp = &mutexes[id];
+
+  if (mp->owner == NULL) { /* 空いているので，そのまま獲得する */
+    mp->owner = current;
+    mp->next = current->mutex;
+    current->mutex = mp;
+    putcurrent();
+    return 0;
+  }
+
+  if (mp->owner == current) { /* 再帰的なロックは不可 */
+    putcurrent();
+    return -1;
+  }
+
+  /* 待ちキューに繋いでスリープし，所有スレッドに優先度を継承させる */
+  current->wait_mutex = mp;
+  waitque_insert(&mp->waiters, current);
+  mutex_inherit(mp);
+
+  return 0;
+}
+
+/* システム・コールの処理(kz_mutex_unlock():ミューテックスのアンロック) */
+static int thread_mutex_unlock(kz_mutex_id_t id)
+{
+  kz_mutex *mp = &mutexes[id];
+
+  if (mp->owner != current) { /* 所有していないロックは解除できない */
+    putcurrent();
+    return -1;
+  }
+
+  mutex_release(mp);
+  putcurrent();
+
+  /* 待ちスレッドがロックを獲得したので，レディー状態にする */
+  if (mp->owner) {
+    current = mp->owner;
+    putcurrent();
+  }
+
+  return 0;
+}
+
 /* システム・コールの処理(kz_kmalloc():動的メモリ獲得) */
 static void *thread_kmalloc(int size)
 {
@@ -244,97 +950,693 @@ static int thread_kmfree(char *p)
   return 0;
 }
 
-/* メッセージの送信処理 */
-static void sendmsg(kz_msgbox *mboxp, kz_thread *thp, int size, char *p)
+/* メッセージの送信処理(pri はメッセージの優先度) */
+static void sendmsg(kz_msgbox *mboxp, kz_thread *thp, int size, char *p,
+                    int copy, int pri)
 {
   kz_msgbuf *mp;
 
-  /* メッセージ・バッファの作成 */
-  mp = (kz_msgbuf *)kzmem_alloc(sizeof(*mp));
-  if (mp == NULL)
-    kz_sysdown();
+  /*
+   * 空きメッセージ・バッファを取り出す．
+   * limit はメッセージ・バッファの数以下なので，count が limit 未満ならば
+   * 空きは必ずある．
+   */
+  mp = mboxp->freebufs;
+  mboxp->freebufs = mp->next;
   mp->next       = NULL;
   mp->sender     = thp;
   mp->param.size = size;
   mp->param.p    = p;
+  mp->flags      = copy ? KZ_MSGBUF_FLAG_COPIED : 0;
+  if (thp && (thp->flags & KZ_THREAD_FLAG_CALLWAIT))
+    mp->flags |= KZ_MSGBUF_FLAG_CALL;
+  if (copy) { /* 送信元のバッファは再利用されるので，ここにコピーしておく */
+    memcpy(mp->data, p, size);
+    mp->param.p = mp->data;
+  }
+
+  /* 優先度ごとのキューの末尾にメッセージを接続する */
+  if (mboxp->que[pri].tail) {
+    mboxp->que[pri].tail->next = mp;
+  } else {
+    mboxp->que[pri].head = mp;
+    mboxp->quemap |= readyque_bit[pri];
+  }
+  mboxp->que[pri].tail = mp;
+
+  if (++mboxp->count > mboxp->maxcount)
+    mboxp->maxcount = mboxp->count;
+}
+
+/* 空きのできたメッセージ・ボックスに，送信待ちスレッドのメッセージを入れる */
+static void msgbox_resume(kz_msgbox *mboxp)
+{
+  kz_thread *thp, *curthp = current;
+  kz_syscall_param_t *param;
+
+  while (mboxp->senders && (mboxp->count < mboxp->limit)) {
+    thp = mboxp->senders;
+    mboxp->senders = thp->next;
+    thp->next = NULL;
+    thp->wait_msgbox = NULL;
+
+    param = thp->syscall.param;
+    if (thp->flags & KZ_THREAD_FLAG_CALLWAIT) {
+      /* kz_call() はそのまま返信待ちを続ける */
+      sendmsg(mboxp, thp, param->un.call.size, *(param->un.call.pp), 0,
+              KZ_MSG_PRI_DEFAULT);
+      continue;
+    }
+
+    /*
+     * kz_send_copy() と kz_send_pri() も先頭の引数の並びが同じなので
+     * un.send で参照できる．(kz_send_pri() は戻り値の位置が異なる)
+     */
+    if (thp->flags & KZ_THREAD_FLAG_SENDPRI) {
+      sendmsg(mboxp, thp, param->un.send.size, param->un.send.p, 0,
+              param->un.send_pri.pri);
+      param->un.send_pri.ret = param->un.send.size;
+    } else {
+      sendmsg(mboxp, thp, param->un.send.size, param->un.send.p,
+              (thp->flags & KZ_THREAD_FLAG_SENDCOPY) ? 1 : 0,
+              KZ_MSG_PRI_DEFAULT);
+      param->un.send.ret = param->un.send.size;
+    }
+    thp->flags &= ~(KZ_THREAD_FLAG_SENDCOPY | KZ_THREAD_FLAG_SENDPRI);
+
+    current = thp;
+    putcurrent(); /* 送信できたので，ブロック解除する */
+  }
+
+  current = curthp;
+}
+
+/* メッセージ・ボックスの初期化(メッセージ・バッファを振り分ける) */
+static void msgbox_init(void)
+{
+  kz_msgbox *mboxp;
+  kz_msgbuf *mp = msgbufs;
+  int i;
+
+  memset(msgboxes, 0, sizeof(msgboxes));
+  for (mboxp = msgboxes; mboxp < &msgboxes[MSGBOX_NUM]; mboxp++) {
+    for (i = 0; i < MSGBUF_NUM; i++, mp++) {
+      mp->next = mboxp->freebufs;
+      mboxp->freebufs = mp;
+    }
+    mboxp->limit = MSGBUF_NUM;
+  }
+
+  /* 固定のIDのメッセージ・ボックスは最初から使用中にしておく */
+  for (mboxp = msgboxes; mboxp < &msgboxes[MSGBOX_ID_NUM]; mboxp++)
+    mboxp->used = 1;
+}
 
-  /* メッセージ・ボックスの末尾にメッセージを接続する */
-  if (mboxp->tail) {
-    mboxp->tail->next = mp;
+/* IDからメッセージ・ボックスを得る(無効なIDならば NULL を返す) */
+static kz_msgbox *msgbox_get(kz_msgbox_id_t id)
+{
+  kz_msgbox *mboxp;
+
+  if ((unsigned int)id >= MSGBOX_NUM)
+    return NULL;
+  mboxp = &msgboxes[id];
+  return mboxp->used ? mboxp : NULL;
+}
+
+/*
+ * メッセージを受信するスレッドに返す値を設定する．
+ * copy が真ならば p の指すデータを受信側のバッファにコピーする．
+ * kz_recv_copy() の受信バッファ(*pp)にコピーし，kz_recv() のように
+ * 受信バッファが無い場合は *pp に NULL を返す．
+ * ポインタ渡しのメッセージならば，どちらの場合も *pp をそのポインタで
+ * 置き換える．
+ * (kz_recv_copy() も引数の並びが同じなので un.recv で参照できる)
+ */
+static void msg_deliver(kz_thread *receiver, kz_msgbox *mboxp,
+                        kz_thread *sender, int size, char *p, int copy)
+{
+  kz_syscall_param_t *param = receiver->syscall.param;
+  int *sizep;
+  char **pp;
+
+  if (receiver->flags & KZ_THREAD_FLAG_RECVANY) {
+    /* kz_recv_any() は引数の並びが異なり，受信したボックスのIDも返す */
+    sizep = param->un.recv_any.sizep;
+    pp    = param->un.recv_any.pp;
+    if (param->un.recv_any.idp)
+      *(param->un.recv_any.idp) = mboxp - msgboxes;
+    param->un.recv_any.ret = (kz_thread_id_t)sender;
   } else {
-    mboxp->head = mp;
+    sizep = param->un.recv.sizep;
+    pp    = param->un.recv.pp;
+    if (receiver->flags & KZ_THREAD_FLAG_RECVTMO) {
+      /* kz_recv_timeout() は戻り値の位置が異なる */
+      if (receiver->flags & KZ_THREAD_FLAG_SLEEP)
+        sleepque_remove(receiver); /* タイムアウトの取り消し */
+      param->un.recv_timeout.ret = (kz_thread_id_t)sender;
+    } else {
+      param->un.recv.ret = (kz_thread_id_t)sender;
+    }
   }
-  mboxp->tail = mp;
+  if (sizep)
+    *sizep = size;
+  if (pp) {
+    if (!copy)
+      *pp = p;
+    else if ((receiver->flags & KZ_THREAD_FLAG_RECVCOPY) && *pp)
+      memcpy(*pp, p, size);
+    else
+      *pp = NULL;
+  }
+  receiver->flags &= ~(KZ_THREAD_FLAG_RECVCOPY | KZ_THREAD_FLAG_RECVTMO |
+                       KZ_THREAD_FLAG_RECVANY);
 }
 
-/* メッセージの受信処理 */
-static void recvmsg(kz_msgbox *mboxp)
+/* メッセージの受信処理(送信元のスレッドIDを返す) */
+static kz_thread_id_t recvmsg(kz_msgbox *mboxp, kz_thread *receiver)
 {
   kz_msgbuf *mp;
-  kz_syscall_param_t *p;
+  kz_thread *sender;
+  int pri;
 
-  /* メッセージ・ボックスの先頭にあるメッセージを抜き出す */
-  mp = mboxp->head;
-  mboxp->head = mp->next;
-  if (mboxp->head == NULL)
-    mboxp->tail = NULL;
+  /*
+   * 最も優先度の高いキューの先頭にあるメッセージを抜き出す．
+   * (レディー・キューと同様に，ビットマップから優先度を引く)
+   */
+  pri = readyque_ffs[mboxp->quemap];
+  mp = mboxp->que[pri].head;
+  mboxp->que[pri].head = mp->next;
+  if (mboxp->que[pri].head == NULL) {
+    mboxp->que[pri].tail = NULL;
+    mboxp->quemap &= ~readyque_bit[pri];
+  }
   mp->next = NULL;
 
-  /* メッセージを受信するスレッドに返す値を設定する */
-  p = mboxp->receiver->syscall.param;
-  p->un.recv.ret = (kz_thread_id_t)mp->sender;
-  if (p->un.recv.sizep)
-    *(p->un.recv.sizep) = mp->param.size;
-  if (p->un.recv.pp)
-    *(p->un.recv.pp) = mp->param.p;
+  sender = mp->sender;
+  if (mp->flags & KZ_MSGBUF_FLAG_CALL) /* これ以降，kz_reply() で返信できる */
+    sender->flags |= KZ_THREAD_FLAG_CALLRECV;
+  msg_deliver(receiver, mboxp, sender, mp->param.size, mp->param.p,
+              (mp->flags & KZ_MSGBUF_FLAG_COPIED) ? 1 : 0);
+
+  /* メッセージ・バッファを空きリストに戻す */
+  mp->next = mboxp->freebufs;
+  mboxp->freebufs = mp;
+  mboxp->count--;
+
+  msgbox_resume(mboxp); /* 空きができたので送信待ちを解除する */
+
+  return (kz_thread_id_t)sender;
+}
+
+/*
+ * メッセージの送信(copy が真ならばメッセージの内容をコピーして送る)
+ * pri はメッセージの優先度で，受信待ちのスレッドがいなければ
+ * 優先度ごとのキューに接続する．
+ */
+static int msg_send(kz_msgbox_id_t id, int size, char *p, int copy, int pri)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+  kz_thread *receiver;
+
+  if (mboxp == NULL) {
+    putcurrent();
+    return -1;
+  }
+
+  if ((mboxp->receivers == NULL) && (mboxp->count >= mboxp->limit)) {
+    /*
+     * メッセージ・ボックスが満杯なので，受信されて空きができるまで
+     * 送信スレッドをスリープさせる．(システム・コールがブロックする)
+     * 割込みハンドラからのサービス・コールと kz_batch() の中では
+     * 待てないのでエラーを返す．
+     */
+    if ((current == NULL) || (current->flags & KZ_THREAD_FLAG_NOWAIT))
+      return -1;
+    current->wait_msgbox = mboxp;
+    if (copy)
+      current->flags |= KZ_THREAD_FLAG_SENDCOPY;
+    waitque_insert(&mboxp->senders, current);
+    return -1;
+  }
+
+  /* kz_call() は返信を待つので，送信スレッドをレディーにしない */
+  if ((current == NULL) || !(current->flags & KZ_THREAD_FLAG_CALLWAIT))
+    putcurrent();
 
-  /* 受信待ちスレッドはいなくなったので，NULLに戻す */
-  mboxp->receiver = NULL;
+  if (mboxp->receivers == NULL) {
+    sendmsg(mboxp, current, size, p, copy, pri); /* メッセージの送信処理 */
+    return size;
+  }
+
+  /*
+   * 受信待ちスレッドが存在している場合には，メッセージ・バッファを
+   * 経由せずに，最も優先度の高い受信待ちスレッドに直接渡す．
+   * (受信待ちならばメッセージ・ボックスは空なので，順序は入れ替わらない)
+   * 受信スレッドはレディーになり，送信スレッドよりも優先度が高ければ
+   * このシステム・コールの出口(thread_intr() の schedule())で
+   * そのまま受信スレッドに切替わる．
+   * kz_recv_any() で待っている場合は，他のメッセージ・ボックスに
+   * 接続している受信待ちノードもここで外す．
+   */
+  receiver = mboxp->receivers->thread;
+  recvwait_remove(receiver);
+  if (current && (current->flags & KZ_THREAD_FLAG_CALLWAIT))
+    current->flags |= KZ_THREAD_FLAG_CALLRECV; /* 受信されたので返信できる */
+  msg_deliver(receiver, mboxp, current, size, p, copy);
+  current = receiver;
+  putcurrent(); /* 受信により動作可能になったので，ブロック解除する */
 
-  /* メッセージ・バッファの解放 */
-  kzmem_free(mp);
+  return size;
 }
 
 /* システム・コールの処理(kz_send():メッセージ送信) */
 static int thread_send(kz_msgbox_id_t id, int size, char *p)
 {
-  kz_msgbox *mboxp = &msgboxes[id];
+  return msg_send(id, size, p, 0, KZ_MSG_PRI_DEFAULT);
+}
+
+/* システム・コールの処理(kz_send_pri():優先度付きのメッセージ送信) */
+static int thread_send_pri(kz_msgbox_id_t id, int size, char *p, int pri)
+{
+  kz_thread *thp = current;
+  int ret;
+
+  if ((unsigned int)pri >= KZ_MSG_PRI_NUM) {
+    putcurrent();
+    return -1;
+  }
+
+  thp->flags |= KZ_THREAD_FLAG_SENDPRI; /* 送信待ちになった場合に参照する */
+  ret = msg_send(id, size, p, 0, pri);
+  if (thp->wait_msgbox == NULL)
+    thp->flags &= ~KZ_THREAD_FLAG_SENDPRI;
+
+  return ret;
+}
+
+/* システム・コールの処理(kz_send_copy():メッセージ内容のコピー送信) */
+static int thread_send_copy(kz_msgbox_id_t id, int size, char *p)
+{
+  if ((size < 0) || (size > KZ_MSG_INLINE_SIZE)) {
+    putcurrent();
+    return -1;
+  }
+  return msg_send(id, size, p, 1, KZ_MSG_PRI_DEFAULT);
+}
+
+/*
+ * システム・コールの処理(kz_call():メッセージを送信して返信を待つ)
+ * 送信と返信待ちを１回のシステム・コールで行う．*pp のメッセージを送信し，
+ * kz_reply() で返信されると *pp に返信のメッセージを設定して，
+ * 返信のサイズを返す．受信側は kz_recv() の戻り値(送信元のスレッドID)を
+ * kz_reply() に渡して返信する．
+ */
+static int thread_call(kz_msgbox_id_t id, int size, char **pp)
+{
+  if (msgbox_get(id) == NULL) {
+    putcurrent();
+    return -1;
+  }
+
+  current->flags |= KZ_THREAD_FLAG_CALLWAIT;
+  msg_send(id, size, *pp, 0, KZ_MSG_PRI_DEFAULT);
+  return -1; /* 戻り値は kz_reply() で設定する */
+}
+
+/*
+ * システム・コールの処理(kz_reply():kz_call() への返信)
+ * 返信を待っているスレッドをレディー・キューの先頭に繋ぐので，
+ * 同じ優先度の他のスレッドよりも先に実行される．返信したスレッドと
+ * 同じ優先度ならば，このシステム・コールの出口でそのまま切替わる．
+ */
+static int thread_reply(kz_thread_id_t id, int size, char *p)
+{
+  kz_thread *thp = (kz_thread *)id;
+  kz_syscall_param_t *param = thp->syscall.param;
+
+  /*
+   * 返信待ちでない．送信待ちの場合や，メッセージ・ボックスに格納された
+   * ままでまだ受信されていない場合も，返信は受け付けない．
+   */
+  if (!(thp->flags & KZ_THREAD_FLAG_CALLWAIT) ||
+      !(thp->flags & KZ_THREAD_FLAG_CALLRECV)) {
+    putcurrent();
+    return -1;
+  }
+
+  thp->flags &= ~(KZ_THREAD_FLAG_CALLWAIT | KZ_THREAD_FLAG_CALLRECV);
+  *(param->un.call.pp) = p;
+  param->un.call.ret = size;
 
   putcurrent();
-  sendmsg(mboxp, current, size, p); /* メッセージの送信処理 */
+  readyque_push(thp); /* 返信により動作可能になったので，ブロック解除する */
+  return 0;
+}
+
+/*
+ * システム・コールの処理(kz_msgbox_setlimit():格納数の上限の設定)
+ * limit が0以下かメッセージ・バッファの数を超える場合は，
+ * メッセージ・バッファの数(上限なしと同じ)にする．
+ */
+static int thread_msgbox_setlimit(kz_msgbox_id_t id, int limit)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+  int old;
 
-  /* 受信待ちスレッドが存在している場合には受信処理を行う */
-  if (mboxp->receiver) {
-    current = mboxp->receiver; /* 受信待ちスレッド */
-    recvmsg(mboxp); /* メッセージの受信処理 */
-    putcurrent(); /* 受信により動作可能になったので，ブロック解除する */
+  if (mboxp == NULL) {
+    putcurrent();
+    return -1;
   }
+  old = mboxp->limit;
 
-  return size;
+  if ((limit <= 0) || (limit > MSGBUF_NUM))
+    limit = MSGBUF_NUM;
+  mboxp->limit = limit;
+
+  putcurrent();
+  msgbox_resume(mboxp); /* 上限が増えた場合は送信待ちを解除する */
+  return old;
+}
+
+/* システム・コールの処理(kz_msgbox_getinfo():格納状況の取得) */
+static int thread_msgbox_getinfo(kz_msgbox_id_t id, kz_msgboxinfo_t *info)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  putcurrent();
+  if (mboxp == NULL)
+    return -1;
+
+  info->count    = mboxp->count;
+  info->limit    = mboxp->limit;
+  info->maxcount = mboxp->maxcount;
+  return 0;
+}
+
+/*
+ * システム・コールの処理(kz_msgbox_create():メッセージ・ボックスの作成)
+ * 未使用のメッセージ・ボックスを割り当て，そのIDを返す．
+ */
+static int thread_msgbox_create(int limit)
+{
+  kz_msgbox *mboxp;
+
+  putcurrent();
+
+  if ((limit <= 0) || (limit > MSGBUF_NUM))
+    limit = MSGBUF_NUM;
+
+  for (mboxp = &msgboxes[MSGBOX_ID_NUM]; mboxp < &msgboxes[MSGBOX_NUM];
+       mboxp++) {
+    if (!mboxp->used) {
+      mboxp->used = 1;
+      mboxp->limit = limit;
+      mboxp->maxcount = 0;
+      return mboxp - msgboxes;
+    }
+  }
+
+  return -1; /* 空きが無い */
+}
+
+/*
+ * システム・コールの処理(kz_msgbox_delete():メッセージ・ボックスの削除)
+ * 固定のIDのものや，メッセージが残っているか待ちスレッドのいる
+ * メッセージ・ボックスは削除できない．
+ */
+static int thread_msgbox_delete(kz_msgbox_id_t id)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  putcurrent();
+
+  if ((mboxp == NULL) || ((unsigned int)id < MSGBOX_ID_NUM))
+    return -1;
+  if (mboxp->quemap || mboxp->receivers || mboxp->senders)
+    return -1;
+
+  mboxp->used = 0;
+  return 0;
 }
 
 /* システム・コールの処理(kz_recv():メッセージ受信) */
 static kz_thread_id_t thread_recv(kz_msgbox_id_t id, int *sizep, char **pp)
 {
-  kz_msgbox *mboxp = &msgboxes[id];
+  kz_msgbox *mboxp = msgbox_get(id);
 
-  if (mboxp->receiver) /* 他のスレッドがすでに受信待ちしている */
-    kz_sysdown();
-
-  mboxp->receiver = current; /* 受信待ちスレッドに設定 */
+  if (mboxp == NULL) {
+    current->flags &= ~(KZ_THREAD_FLAG_RECVCOPY | KZ_THREAD_FLAG_RECVTMO);
+    putcurrent();
+    return KZ_RECV_FAIL;
+  }
 
-  if (mboxp->head == NULL) {
+  if (!mboxp->quemap) {
     /*
      * メッセージ・ボックスにメッセージが無いので，スレッドを
      * スリープさせる．(システム・コールがブロックする)
+     * 複数のスレッドが受信待ちできるので，優先度順に並べておき，
+     * メッセージは優先度の高いスレッドから渡す．
      */
+    recvwait_insert(current, mboxp);
     return -1;
   }
 
-  recvmsg(mboxp); /* メッセージの受信処理 */
-  putcurrent(); /* メッセージを受信できたので，レディー状態にする */
+  putcurrent(); /* メッセージを受信できるので，レディー状態にする */
+  return recvmsg(mboxp, current); /* メッセージの受信処理 */
+}
+
+/* システム・コールの処理(kz_tryrecv():メッセージが無ければ待たない受信) */
+static kz_thread_id_t thread_tryrecv(kz_msgbox_id_t id, int *sizep, char **pp)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  if ((mboxp == NULL) || !mboxp->quemap) {
+    putcurrent();
+    return KZ_RECV_FAIL;
+  }
+  return thread_recv(id, sizep, pp);
+}
+
+/*
+ * システム・コールの処理(kz_recv_timeout():タイムアウト付きの受信)
+ * msec の経過までに受信できなければ KZ_RECV_FAIL を返す．
+ * msec が0ならば kz_tryrecv() と同じで，負ならばタイムアウトしない．
+ */
+static kz_thread_id_t thread_recv_timeout(kz_msgbox_id_t id, int *sizep,
+                                          char **pp, int msec)
+{
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  if (mboxp && !mboxp->quemap) {
+    if (msec == 0) {
+      putcurrent();
+      return KZ_RECV_FAIL;
+    }
+    current->flags |= KZ_THREAD_FLAG_RECVTMO;
+    if (msec > 0)
+      sleepque_insert(current, (msec + TICK_MSEC - 1) / TICK_MSEC);
+  }
+  return thread_recv(id, sizep, pp);
+}
+
+/*
+ * システム・コールの処理(kz_recv_any():複数のメッセージ・ボックスからの受信)
+ * ids[] の先頭から見てメッセージのあるボックスから受信する．どれにも
+ * 無ければ，すべてのボックスに受信待ちノードを接続してスリープし，
+ * 最初に送信されたボックスから受信する．受信したボックスのIDは *idp に返す．
+ */
+static kz_thread_id_t thread_recv_any(int num, kz_msgbox_id_t *ids,
+                                      kz_msgbox_id_t *idp, int *sizep,
+                                      char **pp)
+{
+  kz_msgbox *mboxp, *ready = NULL;
+  int i;
+
+  if ((num <= 0) || (num > KZ_RECV_ANY_MAX)) {
+    putcurrent();
+    return KZ_RECV_FAIL;
+  }
+  for (i = 0; i < num; i++) {
+    mboxp = msgbox_get(ids[i]);
+    if (mboxp == NULL) {
+      putcurrent();
+      return KZ_RECV_FAIL;
+    }
+    if (mboxp->quemap && (ready == NULL))
+      ready = mboxp;
+  }
+
+  /* kz_recv_copy() と同様に，*pp が指す受信バッファにもコピーできる */
+  current->flags |= KZ_THREAD_FLAG_RECVANY | KZ_THREAD_FLAG_RECVCOPY;
+
+  if (ready) {
+    putcurrent();
+    return recvmsg(ready, current);
+  }
+
+  for (i = 0; i < num; i++)
+    recvwait_insert(current, &msgboxes[ids[i]]);
+  return -1;
+}
+
+/* システム・コールの処理(kz_recv_copy():受信バッファへのメッセージ受信) */
+static kz_thread_id_t thread_recv_copy(kz_msgbox_id_t id, int *sizep,
+                                       char **pp)
+{
+  current->flags |= KZ_THREAD_FLAG_RECVCOPY;
+  return thread_recv(id, sizep, pp);
+}
+
+/* システム・コールの処理(kz_getstat():統計情報の取得) */
+static int thread_getstat(kz_stat_t *stat)
+{
+  *stat = kzinfo.stat;
+  putcurrent();
+  return 0;
+}
+
+/*
+ * 以下のセマフォとイベント・フラグの処理は，サービス・コールとして
+ * 割込みハンドラからも呼ばれる(current == NULL)．メッセージと違って
+ * メモリを獲得しないので，通知だけならばこちらを使う方が軽い．
+ */
+
+/* システム・コールの処理(kz_sem_wait():セマフォの獲得) */
+static int thread_sem_wait(kz_sem_id_t id)
+{
+  kz_sem *sp = &sems[id];
+
+  if (sp->count > 0) {
+    sp->count--;
+    putcurrent();
+    return 0;
+  }
+
+  /* 資源が無いので，獲得待ちでスリープする */
+  current->wait_que = &sp->waiters;
+  waitque_insert(&sp->waiters, current);
+  return 0;
+}
+
+/* システム・コールの処理(kz_sem_post():セマフォの解放) */
+static int thread_sem_post(kz_sem_id_t id)
+{
+  kz_sem *sp = &sems[id];
+  kz_thread *thp;
+
+  putcurrent();
+
+  /* 待ちスレッドがいれば資源を直接渡し，いなければ数を増やす */
+  thp = sp->waiters;
+  if (thp) {
+    waitque_remove(&sp->waiters, thp);
+    thp->wait_que = NULL;
+    current = thp;
+    putcurrent();
+  } else {
+    sp->count++;
+  }
+
+  return 0;
+}
+
+/* イベント・フラグの待ち条件の判定 */
+static uint16 flag_match(kz_flag *fp, uint16 pattern, int mode)
+{
+  uint16 match = fp->pattern & pattern;
+
+  if (mode & KZ_FLAG_AND)
+    return (match == pattern) ? match : 0;
+  return match;
+}
+
+/* 待ち条件の成立したスレッドを起こす */
+static void flag_release(kz_flag *fp)
+{
+  kz_thread *thp, *next;
+  kz_syscall_param_t *p;
+  uint16 match;
+
+  for (thp = fp->waiters; thp; thp = next) {
+    next = thp->next;
+    p = thp->syscall.param;
+    match = flag_match(fp, p->un.flag_wait.pattern, p->un.flag_wait.mode);
+    if (!match)
+      continue;
+
+    p->un.flag_wait.ret = match;
+    if (p->un.flag_wait.mode & KZ_FLAG_CLEAR)
+      fp->pattern &= ~p->un.flag_wait.pattern;
 
-  return current->syscall.param->un.recv.ret;
+    waitque_remove(&fp->waiters, thp);
+    thp->wait_que = NULL;
+    current = thp;
+    putcurrent();
+  }
+}
+
+/* システム・コールの処理(kz_flag_wait():イベント・フラグ待ち) */
+static uint16 thread_flag_wait(kz_flag_id_t id, uint16 pattern, int mode)
+{
+  kz_flag *fp = &eventflags[id];
+  uint16 match;
+
+  match = flag_match(fp, pattern, mode);
+  if (match) {
+    if (mode & KZ_FLAG_CLEAR)
+      fp->pattern &= ~pattern;
+    putcurrent();
+    return match;
+  }
+
+  /* 条件が成立していないので，待ちキューに繋いでスリープする */
+  current->wait_que = &fp->waiters;
+  waitque_insert(&fp->waiters, current);
+  return 0;
+}
+
+/* システム・コールの処理(kz_flag_set():イベント・フラグのセット) */
+static int thread_flag_set(kz_flag_id_t id, uint16 pattern)
+{
+  kz_flag *fp = &eventflags[id];
+
+  putcurrent();
+  fp->pattern |= pattern;
+  flag_release(fp);
+
+  return 0;
+}
+
+/* システム・コールの処理(kz_flag_clear():イベント・フラグのクリア) */
+static int thread_flag_clear(kz_flag_id_t id, uint16 pattern)
+{
+  eventflags[id].pattern &= ~pattern;
+  putcurrent();
+  return 0;
+}
+
+/* システム・コールの処理(kz_getstack():スタック使用量の取得) */
+static int thread_getstack(kz_stackinfo_t *info, int num)
+{
+  kz_thread *thp;
+  int n = 0;
+
+  for (thp = threads; thp < &threads[THREAD_NUM] && n < num; thp++) {
+    if (!thp->init.func) /* 未使用のTCB */
+      continue;
+    strcpy(info->name, thp->name);
+    info->size = thp->stacksize;
+#ifdef KZ_STACK_CHECK
+    info->used = thp->stacksize - stack_margin(thp);
+#else
+    info->used = -1;
+#endif
+    info++;
+    n++;
+  }
+
+  putcurrent();
+  return n;
 }
 
 static int thread_setintr(softvec_type_t type, kz_handler_t handler){
@@ -346,50 +1648,89 @@ static int thread_setintr(softvec_type_t type, kz_handler_t handler){
 }
 
 
+/* サービス・コールとして実行できる(kx_xxx() のある)システム・コール */
+static const uint8 syscall_srvcall[KZ_SYSCALL_TYPE_NUM] = {
+#define KZ_SRVCALL_NONE 0
+#define KZ_SRVCALL_NORET 0
+#define KZ_SRVCALL_SYS  0
+#define KZ_SRVCALL_SRV  1
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) KZ_SRVCALL_##stub,
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+};
+
+static void call_functions(kz_syscall_type_t type, kz_syscall_param_t *p);
+
+/*
+ * システム・コールの処理(kz_batch():システム・コールをまとめて実行する)
+ * ops[] のシステム・コールを１回のトラップで順に実行し，それぞれの
+ * 戻り値は ops[].param に返す．サービス・コールと同様に待ちに入らずに
+ * 実行するので，kx_xxx() のあるものだけを実行できる．
+ * 実行できないものや，満杯のメッセージ・ボックスへの送信(待ちになる
+ * 操作)があればそこで打ち切り，最後まで実行できた数を返す．
+ */
+static int thread_batch(kz_batch_t *ops, int num)
+{
+  kz_thread *thp = current;
+  kz_batch_t *op;
+  int i;
+
+  thp->flags |= KZ_THREAD_FLAG_NOWAIT;
+  for (i = 0; i < num; i++) {
+    op = &ops[i];
+    if (((unsigned int)op->type >= KZ_SYSCALL_TYPE_NUM) ||
+        !syscall_srvcall[op->type])
+      break;
+    current = thp; /* 処理関数の中で書き換えられるので毎回戻す */
+    call_functions(op->type, &op->param);
+    if (((op->type == KZ_SYSCALL_TYPE_SEND) ||
+         (op->type == KZ_SYSCALL_TYPE_SEND_COPY)) &&
+        (op->param.un.send.ret < 0))
+      break;
+  }
+  thp->flags &= ~KZ_THREAD_FLAG_NOWAIT;
+
+  current = thp;
+  putcurrent();
+  return i;
+}
+
+/*
+ * システム・コールの処理関数とそのテーブル(syscall_def.h から生成する)
+ * 処理関数はパラメータ格納域から引数を取り出して thread_xxx() を呼び，
+ * 戻り値を格納する．(NORET のものは p が NULL の場合があるので格納しない)
+ */
+#define KZ_SYSARG(x, i, t, a) KZ_SEP_##i p->un.x.a
+#define KZ_SYSRET_SYS(x)   p->un.x.ret =
+#define KZ_SYSRET_SRV(x)   p->un.x.ret =
+#define KZ_SYSRET_NONE(x)  p->un.x.ret =
+#define KZ_SYSRET_NORET(x) (void)
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...)                 \
+static void syscall_##name(kz_syscall_param_t *p)                   \
+{                                                                   \
+  KZ_SYSRET_##stub(name)                                            \
+    thread_##name(KZ_EACH(n, KZ_SYSARG, name, ##__VA_ARGS__));      \
+}
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+
+static void (* const syscall_funcs[KZ_SYSCALL_TYPE_NUM])(kz_syscall_param_t *p) = {
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) syscall_##name,
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+};
+
 static void call_functions(kz_syscall_type_t type,kz_syscall_param_t *p){
-    switch(type){
-        case KZ_SYSCALL_TYPE_RUN:
-            p->un.run.ret = thread_run(p->un.run.func,p->un.run.name,p->un.run.priority,p->un.run.stacksize,p->un.run.argc,p->un.run.argv);
-            break;
-        case KZ_SYSCALL_TYPE_EXIT:
-            thread_exit();
-            break;
-        case KZ_SYSCALL_TYPE_WAIT:
-            p->un.wait.ret = thread_wait();
-            break;
-        case KZ_SYSCALL_TYPE_SLEEP: /* kz_sleep() */
-            p->un.sleep.ret = thread_sleep();
-            break;
-        case KZ_SYSCALL_TYPE_WAKEUP: /* kz_wakeup() */
-            p->un.wakeup.ret = thread_wakeup(p->un.wakeup.id);
-            break;
-        case KZ_SYSCALL_TYPE_GETID: /* kz_getid() */
-            p->un.getid.ret = thread_getid();
-            break;
-        case KZ_SYSCALL_TYPE_CHPRI: /* kz_chpri() */
-            p->un.chpri.ret = thread_chpri(p->un.chpri.priority);
-            break;
-        case KZ_SYSCALL_TYPE_KMALLOC: /* kz_kmalloc() */
-            p->un.kmalloc.ret = thread_kmalloc(p->un.kmalloc.size);
-            break;
-        case KZ_SYSCALL_TYPE_KMFREE: /* kz_kmfree() */
-            p->un.kmfree.ret = thread_kmfree(p->un.kmfree.p);
-            break;
-        case KZ_SYSCALL_TYPE_SEND: /* kz_send() */
-            p->un.send.ret = thread_send(p->un.send.id,
-                                         p->un.send.size, p->un.send.p);
-            break;
-        case KZ_SYSCALL_TYPE_RECV: /* kz_recv() */
-            p->un.recv.ret = thread_recv(p->un.recv.id,
-                                         p->un.recv.sizep, p->un.recv.pp);
-            break;
-        case KZ_SYSCALL_TYPE_SETINTR: /* kz_setintr() */
-            p->un.setintr.ret = thread_setintr(p->un.setintr.type,
-                                               p->un.setintr.handler);
-            break;
-        default:
-            break;
-        }
+    /* システム・コール番号でテーブルを引いて，処理関数を呼び出す */
+    if((unsigned int)type < KZ_SYSCALL_TYPE_NUM){
+        syscall_funcs[type](p);
+    }
 }
 
 static void syscall_proc(kz_syscall_type_t type,kz_syscall_param_t *p){
@@ -415,19 +1756,123 @@ static void srvcall_proc(kz_syscall_type_t type, kz_syscall_param_t *p)
 
 static void schedule(void){
     int i;
-    for (i = 0; i < PRIORITY_NUM; i++)
-    {
+
+#ifdef KZ_SCHED_LINEAR
+    /*
+     * ベンチマーク(test12_1.c)での比較用に，ビットマップを使う前と同じく
+     * レディー・キューを優先度順に線形に探す．(ビットマップの更新は
+     * getcurrent()/putcurrent() で行われたままになる)
+     */
+    for (i = 0; i < PRIORITY_NUM; i++) {
         if (readyque[i].head) /* 見つかった */
             break;
     }
     if (i == PRIORITY_NUM) /* 見つからなかった */
         kz_sysdown();
+#else
+    /* ビットマップから優先度の最も高いレディー・キューを引く */
+    i = readyque_bitmap_top();
+    if (i < 0) /* 見つからなかった */
+        kz_sysdown();
+#endif
 
     current = readyque[i].head; /* カレント・スレッドに設定する */
 }
 
+#ifndef KZ_SYSCALL_PARAM_ABI
+/*
+ * レジスタ渡しのシステム・コール
+ * er0 にシステム・コール番号，er1～er3 に引数を入れて trapa #0 する．
+ * 戻り値は er0 で返す．レジスタは intr.S でスレッドのスタックに
+ * er0 から順に退避されているので，context.sp の指す先から読み出せる．
+ * 引数はTCB内のバッファに展開して，従来の処理関数をそのまま利用する．
+ * (kz_run() のように引数が４つ以上あるものは，パラメータの領域を
+ *  er1 で渡す)
+ */
+#define KZ_DECARG(x, i, t, a) p->un.x.a = (t)frame[i];
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...)               \
+static void syscall_decode_##name(kz_syscall_param_t *p, uint32 *frame) \
+{                                                                 \
+  KZ_EACH(n, KZ_DECARG, name, ##__VA_ARGS__)                      \
+}
+#define KZ_SYSCALL_BLOCK(rtype, name, NAME, stub, n, ...)         \
+static void syscall_decode_##name(kz_syscall_param_t *p, uint32 *frame) \
+{                                                                 \
+  p->un.name = ((kz_syscall_param_t *)frame[1])->un.name;         \
+}
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+
+static void (* const syscall_decode[KZ_SYSCALL_TYPE_NUM])(kz_syscall_param_t *p, uint32 *frame) = {
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) syscall_decode_##name,
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+};
+
+/*
+ * 戻り値の格納位置とサイズ．
+ * 戻り値をスレッドのスタック上の er0 に書き戻すときに使う．
+ */
+static const struct {
+  uint8 offset;
+  uint8 size;
+} syscall_ret[KZ_SYSCALL_TYPE_NUM] = {
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) \
+  { __builtin_offsetof(kz_syscall_param_t, un.name.ret), sizeof(rtype) },
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+};
+
+/*
+ * 戻り値をスレッドのスタック上の er0 に書き戻す．
+ * kz_recv() のように待ちに入ったシステム・コールは後から戻り値が
+ * 設定されるので，スレッドが再び実行される直前に行う．
+ */
+static void syscall_setret(kz_thread *thp)
+{
+  kz_syscall_type_t type = thp->syscall.type;
+  char *p = (char *)thp->syscall.param + syscall_ret[type].offset;
+  uint32 ret;
+
+  if (syscall_ret[type].size == sizeof(uint32))
+    ret = *(uint32 *)p;
+  else
+    ret = *(uint16 *)p;
+
+  *(uint32 *)thp->context.sp = ret;
+  thp->syscall.pending = 0;
+}
+#endif
+
+#ifdef KZ_DIRECTCALL
+/* 処理済みのシステム・コールからの，スレッド切替えのためのトラップ */
+#define SYSCALL_TYPE_SWITCH KZ_SYSCALL_TYPE_NUM
+#endif
+
 static void syscall_intr(void){
+#ifdef KZ_SYSCALL_PARAM_ABI
+#ifdef KZ_DIRECTCALL
+    if(current->syscall.type == SYSCALL_TYPE_SWITCH){
+        return; /* 切替えはこの後の schedule() で行う */
+    }
+#endif
+    syscall_proc(current->syscall.type,current->syscall.param);
+#else
+    uint32 *frame = (uint32 *)current->context.sp; /* er0～er6 */
+
+    current->syscall.type = (kz_syscall_type_t)frame[0];
+    current->syscall.param = &current->syscall.regs;
+    if((unsigned int)current->syscall.type < KZ_SYSCALL_TYPE_NUM){
+        current->syscall.pending = 1;
+        syscall_decode[current->syscall.type](current->syscall.param, frame);
+    }
     syscall_proc(current->syscall.type,current->syscall.param);
+#endif
 }
 
 static void softerr_intr(void){
@@ -437,31 +1882,225 @@ static void softerr_intr(void){
     thread_exit();
 }
 
+/* ティックを n 進め，起床時刻になったスレッドをすべて起こす */
+static void tick_advance(int n){
+    kz_thread *thp, *curthp = current;
+
+    kzinfo.stat.ticks += n;
+
+    while(sleepque && sleepque->sleep.delta <= n){
+        thp = sleepque;
+        n -= thp->sleep.delta;
+        sleepque = thp->sleep.next;
+        thp->sleep.next = NULL;
+        thp->flags &= ~(KZ_THREAD_FLAG_SLEEP | KZ_THREAD_FLAG_WAKEUP);
+        if(thp->recvwait_num){ /* 受信待ちのタイムアウト */
+            msg_timeout(thp);
+        }
+
+        current = thp;
+        putcurrent();
+    }
+    if(sleepque){
+        sleepque->sleep.delta -= n;
+    }
+
+    current = curthp;
+}
+
+/*
+ * タイム・スライスの処理
+ * 実行中のスレッドのスライスを使い切ったら，同じ優先度の
+ * レディー・キューの末尾に回す．
+ */
+static void thread_slice(void){
+    if(!current->quantum){
+        return;
+    }
+    if(--current->slice > 0){
+        return;
+    }
+    if(readyque[current->priority].head == current && current->next){
+        getcurrent();
+        putcurrent();
+    }
+    else{
+        current->slice = current->quantum;
+    }
+}
+
+/* ティック割込みの処理 */
+static void tick_intr(void){
+    if(!timer_is_expired(TICK_TIMER_INDEX)){
+        return;
+    }
+    timer_expire(TICK_TIMER_INDEX);
+
+    thread_slice();
+    tick_advance(1);
+}
+
+#ifdef KZ_TICKLESS
+/* アイドルに入る際に，タイマを次の起床時刻まで延ばす */
+static void tickless_enter(void){
+    int n = TICKLESS_MAX;
+
+    /* ティック割込みが保留中ならば，先に通常どおり処理させる */
+    if(timer_is_expired(TICK_TIMER_INDEX)){
+        return;
+    }
+
+    if(sleepque && sleepque->sleep.delta < n){
+        n = sleepque->sleep.delta;
+    }
+    if(n <= 1){
+        return;
+    }
+
+    timer_set_period(TICK_TIMER_INDEX, (uint16)n * TICK_COUNT);
+    tickless_ticks = n;
+}
+
+/* アイドルから抜ける際に，経過したティックをまとめて処理する */
+static void tickless_exit(void){
+    uint16 c1, c2;
+    int expired, n;
+
+    if(!tickless_ticks){
+        return;
+    }
+
+    /* 読み出しの間にカウンタが一周した場合も考慮する */
+    c1 = timer_get_count(TICK_TIMER_INDEX);
+    expired = timer_is_expired(TICK_TIMER_INDEX);
+    c2 = timer_get_count(TICK_TIMER_INDEX);
+    if(!expired && c2 < c1){
+        expired = 1;
+    }
+
+    /* コンペア・マッチしていれば，延ばした周期の分が経過している */
+    n = 0;
+    if(expired){
+        timer_expire(TICK_TIMER_INDEX);
+        n = tickless_ticks;
+    }
+
+    /* 通常のティック周期に戻し，端数はカウンタに残す */
+    timer_set_period(TICK_TIMER_INDEX, TICK_COUNT);
+    timer_set_count(TICK_TIMER_INDEX, c2 % TICK_COUNT);
+    tickless_ticks = 0;
+
+    n += c2 / TICK_COUNT;
+    if(n > 0){
+        kzinfo.stat.skipped += n - (expired ? 1 : 0);
+        tick_advance(n);
+    }
+}
+#endif
+
 static void thread_intr(softvec_type_t type,unsigned long sp){
+#ifndef KZ_NO_FASTPATH
+    kz_thread *thp = current;
+#endif
+
     current->context.sp = sp;
 
+#ifdef KZ_STACK_CHECK
+    /* スタックが溢れていたら，ソフトウエア・エラーとして処理する */
+    if(stack_is_overflow(current)){
+        type = SOFTVEC_TYPE_SOFTERR;
+    }
+#endif
+
+#ifdef KZ_TICKLESS
+    tickless_exit();
+#endif
+
     if(handlers[type]){
         handlers[type]();
     }
     schedule();
 
+#ifdef KZ_TICKLESS
+    /* 同じ優先度のユーザ・スレッドはスライスがあるので対象にしない */
+    if(current == idlethread && current->priority == IDLE_PRIORITY){
+        tickless_enter();
+    }
+#endif
+
+#ifndef KZ_SYSCALL_PARAM_ABI
+    if(current->syscall.pending){
+        syscall_setret(current);
+    }
+#endif
+
+    /* 実行するスレッドの情報を更新する */
+    kzinfo.id = (kz_thread_id_t)current;
+    kzinfo.priority = current->priority;
+
+    /*
+     * 割込まれたスレッドがそのまま実行を続けるならば，dispatch() による
+     * コンテキストの再読込みは不要．このまま戻れば，割込み入口(intr.S)の
+     * 出口処理が割込みスタックに退避したスタック・ポインタからレジスタを
+     * 復旧して rte するので，kz_kmalloc() などの軽いシステム・コールは
+     * ここで戻ることになる．
+     * KZ_NO_FASTPATH ならば，比較のために常に dispatch() で戻る．
+     */
+#ifndef KZ_NO_FASTPATH
+    if(current == thp){
+        kzinfo.stat.fastpath++;
+        return;
+    }
+#endif
+
+    kzinfo.stat.dispatched++;
     dispatch(&current->context);
 }
 
 void kz_start(kz_func_t func ,char *name,int priority,int stacksize,int argc,char *argv[]){
+    kz_thread *thp;
+    extern char userstack;
+
     kzmem_init(); /* 動的メモリの初期化 */
     
     current = NULL;
     
     memset(readyque,0,sizeof(readyque));
+    memset(&readyque_bitmap,0,sizeof(readyque_bitmap));
     memset(threads,0,sizeof(threads));
+    stack_top = &userstack;
+    freestacks = NULL;
+    freethreads = NULL;
+    for(thp = &threads[THREAD_NUM]; thp > threads; ){
+        thp--;
+        thp->next = freethreads;
+        freethreads = thp;
+    }
     memset(handlers,0,sizeof(handlers));
-    memset(msgboxes, 0, sizeof(msgboxes));
+    msgbox_init();
+    memset(mutexes, 0, sizeof(mutexes));
+    memset(sems, 0, sizeof(sems));
+    memset(eventflags, 0, sizeof(eventflags));
+    sleepque = NULL;
+    memset(&kzinfo, 0, sizeof(kzinfo));
+#ifdef KZ_TICKLESS
+    tickless_ticks = 0;
+#endif
 
     thread_setintr(SOFTVEC_TYPE_SYSCALL, syscall_intr); /* システム・コール */
     thread_setintr(SOFTVEC_TYPE_SOFTERR, softerr_intr); /* ダウン要因発生 */
+    thread_setintr(SOFTVEC_TYPE_TIMINTR, tick_intr); /* ティック割込み */
+
+    /* ティック割込みの開始(割込み許可はアイドル・スレッドで行われる) */
+    timer_start(TICK_TIMER_INDEX, TICK_MSEC);
 
-    current = (kz_thread *)thread_run(func,name,priority,stacksize,argc,argv);
+    current = (kz_thread *)thread_run(func,name,priority,0,stacksize,argc,argv);
+#ifdef KZ_TICKLESS
+    /* 最初のスレッドは，優先度を下げてアイドル・スレッドになる */
+    idlethread = current;
+#endif
+    kzinfo.id = (kz_thread_id_t)current;
+    kzinfo.priority = current->priority;
 
     dispatch(&current->context);
 
@@ -473,11 +2112,51 @@ void kz_sysdown(void){
         ;
 }
 
+#ifdef KZ_DIRECTCALL
+/*
+ * 直接呼び出し版のシステム・コール
+ * トラップせずに，割込み禁止にして処理関数を直接呼び出す．
+ * スレッドの切替えが必要になった(待ちに入った，もしくはより優先度の
+ * 高いスレッドがレディーになった)場合にだけトラップし，thread_intr()
+ * でディスパッチする．
+ * kz_exit() は自分のスタックを解放するので，従来通りトラップで処理する．
+ */
+void kz_syscall(kz_syscall_type_t type,kz_syscall_param_t *param){
+    kz_thread *thp = current;
+    uint8 ccr;
+
+    thp->syscall.type = type;
+    thp->syscall.param = param;
+    if(type == KZ_SYSCALL_TYPE_EXIT){
+        asm volatile ("trapa #0");
+        return;
+    }
+
+    INTR_SAVE(ccr);
+    INTR_DISABLE;
+
+    syscall_proc(type,param);
+    schedule();
+
+    if(current != thp){
+        /* 自分はまだ実行中なので，current を戻してからトラップする */
+        current = thp;
+        thp->syscall.type = SYSCALL_TYPE_SWITCH;
+        asm volatile ("trapa #0");
+    } else {
+        kzinfo.priority = thp->priority;
+        kzinfo.stat.fastpath++;
+    }
+
+    INTR_RESTORE(ccr);
+}
+#elif defined(KZ_SYSCALL_PARAM_ABI)
 void kz_syscall(kz_syscall_type_t type,kz_syscall_param_t *param){
     current->syscall.type = type;
     current->syscall.param = param;
     asm volatile ("trapa #0");
 }
+#endif
 
 /* サービス・コール呼び出し用ライブラリ関数 */
 void kz_srvcall(kz_syscall_type_t type, kz_syscall_param_t *param)
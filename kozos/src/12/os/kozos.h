@@ -5,12 +5,16 @@
 #include "interrupt.h"
 #include "syscall.h"
 
-kz_thread_id_t kz_run(kz_func_t func,char *name,int priority,int stacksize,
-                        int argc,char *argv[]);
+/*
+ * quantum は同じ優先度のスレッド間でのタイム・スライス(ミリ秒)．
+ * 0ならばタイム・スライスせず，システム・コールを呼ぶまで実行を続ける．
+ */
+kz_thread_id_t kz_run(kz_func_t func,char *name,int priority,int quantum,
+                        int stacksize,int argc,char *argv[]);
 
 void kz_exit(void);
 int kz_wait(void);
-int kz_sleep(void);
+int kz_sleep(int msec);
 int kz_wakeup(kz_thread_id_t id);
 kz_thread_id_t kz_getid(void);
 int kz_chpri(int priority);
@@ -19,19 +23,112 @@ int kz_kmfree(void *p);
 int kz_send(kz_msgbox_id_t id, int size, char *p);
 kz_thread_id_t kz_recv(kz_msgbox_id_t id, int *sizep, char **pp);
 int kz_setintr(softvec_type_t type, kz_handler_t handler);
+int kz_getstat(kz_stat_t *stat);
+int kz_mutex_lock(kz_mutex_id_t id);
+int kz_mutex_unlock(kz_mutex_id_t id);
+int kz_sem_wait(kz_sem_id_t id);
+int kz_sem_post(kz_sem_id_t id);
+uint16 kz_flag_wait(kz_flag_id_t id, uint16 pattern, int mode);
+int kz_flag_set(kz_flag_id_t id, uint16 pattern);
+int kz_flag_clear(kz_flag_id_t id, uint16 pattern);
+int kz_getstack(kz_stackinfo_t *info, int num);
+
+/*
+ * 小さなメッセージ(KZ_MSG_INLINE_SIZE バイトまで)のコピー送受信．
+ * kz_send_copy() はメッセージの内容をカーネル内にコピーするので，
+ * 送信側のバッファは呼び出し後すぐに再利用できる．
+ * kz_recv_copy() は *pp に受信バッファ(KZ_MSG_INLINE_SIZE バイト以上)を
+ * 設定して呼び出す．コピー送信されたメッセージは受信バッファにコピーし，
+ * kz_send() で送られたメッセージならば *pp をそのポインタで置き換える．
+ */
+int kz_send_copy(kz_msgbox_id_t id, int size, char *p);
+kz_thread_id_t kz_recv_copy(kz_msgbox_id_t id, int *sizep, char **pp);
+
+/*
+ * メッセージが無ければ待たずに KZ_RECV_FAIL を返す受信と，
+ * msec ミリ秒で KZ_RECV_FAIL を返すタイムアウト付きの受信．
+ * (msec が0ならば kz_tryrecv() と同じで，負ならばタイムアウトしない)
+ */
+kz_thread_id_t kz_tryrecv(kz_msgbox_id_t id, int *sizep, char **pp);
+kz_thread_id_t kz_recv_timeout(kz_msgbox_id_t id, int *sizep, char **pp,
+                               int msec);
+
+/*
+ * メッセージ・ボックスに格納できるメッセージ数の上限を設定する．
+ * 満杯のメッセージ・ボックスへの kz_send() は受信されるまでブロックし，
+ * kx_send() は -1 を返す．(limit が0ならば上限はメッセージ・バッファの数)
+ * kz_msgbox_getinfo() で現在の格納数と最大値を取得できる．
+ */
+int kz_msgbox_setlimit(kz_msgbox_id_t id, int limit);
+int kz_msgbox_getinfo(kz_msgbox_id_t id, kz_msgboxinfo_t *info);
+
+/*
+ * メッセージ・ボックスの動的な作成と削除．
+ * kz_msgbox_create() は作成したメッセージ・ボックスのID(作成できなければ
+ * -1)を返す．limit は kz_msgbox_setlimit() と同じ．
+ * 無効なIDに対する送信は -1 を，受信は KZ_RECV_FAIL を返す．
+ */
+int kz_msgbox_create(int limit);
+int kz_msgbox_delete(kz_msgbox_id_t id);
+
+/*
+ * ids[] の num 個(KZ_RECV_ANY_MAX まで)のメッセージ・ボックスのいずれかから
+ * 受信し，受信したボックスのIDを *idp に返す．*pp の扱いは kz_recv_copy()
+ * と同じ(受信バッファを使わないならば NULL を設定して呼び出す)．
+ */
+kz_thread_id_t kz_recv_any(int num, kz_msgbox_id_t ids[], kz_msgbox_id_t *idp,
+                           int *sizep, char **pp);
+
+/*
+ * 同期型のメッセージ送受信．kz_call() は *pp のメッセージを送信して返信を
+ * 待ち，*pp に返信のメッセージを設定して返信のサイズを返す．
+ * 受信側は kz_recv() などで得た送信元のスレッドIDに kz_reply() で返信する．
+ */
+int kz_call(kz_msgbox_id_t id, int size, char **pp);
+int kz_reply(kz_thread_id_t id, int size, char *p);
+
+/*
+ * 複数のシステム・コールを１回のトラップでまとめて実行する．
+ * ops[].type と ops[].param の引数を設定して呼び出すと，先頭から順に
+ * 実行して ops[].param に戻り値を返す．実行できるのはサービス・コール
+ * (kx_xxx())のあるものだけで，それ以外か，満杯で送信できない kz_send() が
+ * あればそこで打ち切る．戻り値は最後まで実行できた数．
+ */
+int kz_batch(kz_batch_t ops[], int num);
+
+/*
+ * 優先度付きのメッセージ送信．pri は 0(最高)～KZ_MSG_PRI_NUM-1 で，
+ * 優先度の高いメッセージから受信される(同じ優先度の中では送信順)．
+ * kz_send() などで送ったメッセージの優先度は KZ_MSG_PRI_DEFAULT になる．
+ */
+int kz_send_pri(kz_msgbox_id_t id, int size, char *p, int pri);
+
+/*
+ * カーネル情報ブロック(読み出し専用)
+ * 実行中のスレッドのIDと優先度，ティック数などの統計情報を，
+ * システム・コールを使わずに KZ_INFO->id のように参照できる．
+ * カーネルがスレッドを実行するたびに更新する．
+ */
+extern kz_info_t kzinfo;
+#define KZ_INFO ((const volatile kz_info_t *)&kzinfo)
 
 /* サービス・コール */
 int kx_wakeup(kz_thread_id_t id);
 void *kx_kmalloc(int size);
 int kx_kmfree(void *p);
 int kx_send(kz_msgbox_id_t id, int size, char *p);
+int kx_sem_post(kz_sem_id_t id);
+int kx_flag_set(kz_flag_id_t id, uint16 pattern);
+int kx_send_copy(kz_msgbox_id_t id, int size, char *p);
 
 void kz_start(kz_func_t func, char *name, int priority, int stacksize,
 	      int argc, char *argv[]);
 
 void kz_sysdown(void);
 
+#ifdef KZ_SYSCALL_PARAM_ABI
 void kz_syscall(kz_syscall_type_t type,kz_syscall_param_t *param);
+#endif
 void kz_srvcall(kz_syscall_type_t type, kz_syscall_param_t *param);
 
 /* システム・タスク */
@@ -40,4 +137,15 @@ int consdrv_main(int argc, char *argv[]);
 /* ユーザ・スレッド */
 int command_main(int argc, char *argv[]);
 
+/* ベンチマーク・スレッド(command の bench コマンドで起動する) */
+int test12_main(int argc, char *argv[]);
+int test12_1_main(int argc, char *argv[]);
+int test12_2_main(int argc, char *argv[]);
+int test12_3_main(int argc, char *argv[]);
+int test12_4_main(int argc, char *argv[]);
+int test12_5_main(int argc, char *argv[]);
+int test12_6_main(int argc, char *argv[]);
+int test12_7_main(int argc, char *argv[]);
+int test12_8_main(int argc, char *argv[]);
+
 #endif
@@ -8,10 +8,10 @@
 /* システム・タスクとユーザ・スレッドの起動 */
 static int start_threads(int argc, char *argv[])
 {
-  kz_run(consdrv_main, "consdrv",  1, 0x200, 0, NULL);
-  kz_run(command_main, "command",  8, 0x200, 0, NULL);
+  kz_run(consdrv_main, "consdrv",  1, 0, 0x200, 0, NULL);
+  kz_run(command_main, "command",  8, 0, 0x200, 0, NULL);
 
-  kz_chpri(15); /* 優先順位を下げて，アイドルスレッドに移行する */
+  kz_chpri(PRIORITY_NUM - 1); /* 優先順位を下げて，アイドルスレッドに移行する */
   INTR_ENABLE; /* 割込み有効にする */
   while (1) {
     asm volatile ("sleep"); /* 省電力モードに移行 */
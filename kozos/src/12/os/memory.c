@@ -19,7 +19,10 @@ typedef struct _kzmem_pool {
   kzmem_block *free;
 } kzmem_pool;
 
-/* メモリ・プールの定義(個々のサイズと個数) */
+/*
+ * メモリ・プールの定義(個々のサイズと個数)
+ * 合計の大きさを変えた場合は，ld.scr の ASSERT() も合わせること．
+ */
 static kzmem_pool pool[] = {
   { 16, 8, NULL }, { 32, 8, NULL }, { 64, 4, NULL },
 };
@@ -2,142 +2,121 @@
 #include "kozos.h"
 #include "syscall.h"
 
-/* システム・コール */
-
-kz_thread_id_t kz_run(kz_func_t func, char *name, int priority,int stacksize,
-		      int argc, char *argv[])
-{
-  kz_syscall_param_t param;
-  param.un.run.func = func;
-  param.un.run.name = name;
-  param.un.run.priority = priority;
-  param.un.run.stacksize = stacksize;
-  param.un.run.argc = argc;
-  param.un.run.argv = argv;
-  kz_syscall(KZ_SYSCALL_TYPE_RUN, &param);
-  return param.un.run.ret;
-}
+/*
+ * システム・コールとサービス・コールのライブラリ関数
+ * syscall_def.h の定義から生成する．
+ */
+
+/* 引数の宣言(引数が無いならば void) */
+#define KZ_PARAM(x, i, t, a) KZ_SEP_##i t a
+#define KZ_VOID_0 void
+#define KZ_VOID_1
+#define KZ_VOID_2
+#define KZ_VOID_3
+#define KZ_VOID_4
+#define KZ_VOID_5
+#define KZ_VOID_7
+#define KZ_PARAMS(n, x, ...) \
+  KZ_VOID_##n KZ_EACH(n, KZ_PARAM, x, ##__VA_ARGS__)
+
+/* パラメータ格納域への引数の設定 */
+#define KZ_SETPARAM(x, i, t, a) param.un.x.a = a;
+
+/* サービス・コール(パラメータ格納域を渡して，直接呼び出す) */
+#define KZ_SRVCALL_STUB(rtype, name, NAME, n, ...)		\
+  rtype kx_##name(KZ_PARAMS(n, name, ##__VA_ARGS__))		\
+  {								\
+    kz_syscall_param_t param;					\
+    KZ_EACH(n, KZ_SETPARAM, name, ##__VA_ARGS__)		\
+    kz_srvcall(KZ_SYSCALL_TYPE_##NAME, &param);			\
+    return param.un.name.ret;					\
+  }
+
+#ifndef KZ_SYSCALL_PARAM_ABI
+/*
+ * レジスタ渡しのシステム・コール呼び出し
+ * er0 にシステム・コール番号，er1～er3 に引数を設定してトラップする．
+ * 戻り値はカーネルが er0 に書き戻す．
+ */
+static uint32 kz_trap(kz_syscall_type_t type, uint32 a1, uint32 a2, uint32 a3)
+{
+  register uint32 er0 asm("er0") = type;
+  register uint32 er1 asm("er1") = a1;
+  register uint32 er2 asm("er2") = a2;
+  register uint32 er3 asm("er3") = a3;
+  asm volatile ("trapa #0"
+		: "+r"(er0)
+		: "r"(er1), "r"(er2), "r"(er3)
+		: "memory");
+  return er0;
+}
+
+/* 使わないレジスタには0を渡す */
+#define KZ_TRAPARG(x, i, t, a) , (uint32)a
+#define KZ_PAD_0 , 0, 0, 0
+#define KZ_PAD_1 , 0, 0
+#define KZ_PAD_2 , 0
+#define KZ_PAD_3
+
+#define KZ_SYSCALL_STUB(rtype, name, NAME, n, ...)			\
+  rtype kz_##name(KZ_PARAMS(n, name, ##__VA_ARGS__))			\
+  {									\
+    return (rtype)kz_trap(KZ_SYSCALL_TYPE_##NAME			\
+			  KZ_EACH(n, KZ_TRAPARG, name, ##__VA_ARGS__)	\
+			  KZ_PAD_##n);					\
+  }
+
+/* 引数が多いものは，パラメータ格納域を er1 で渡す */
+#define KZ_SYSCALL_BLOCK_STUB(rtype, name, NAME, n, ...)		\
+  rtype kz_##name(KZ_PARAMS(n, name, ##__VA_ARGS__))			\
+  {									\
+    kz_syscall_param_t param;						\
+    KZ_EACH(n, KZ_SETPARAM, name, ##__VA_ARGS__)			\
+    return (rtype)kz_trap(KZ_SYSCALL_TYPE_##NAME, (uint32)&param, 0, 0); \
+  }
 
 void kz_exit(void)
 {
-  kz_syscall(KZ_SYSCALL_TYPE_EXIT, NULL);
-}
-
-
-int kz_wait(void)
-{
-  kz_syscall_param_t param;
-  kz_syscall(KZ_SYSCALL_TYPE_WAIT, &param);
-  return param.un.wait.ret;
-}
-
-int kz_sleep(void)
-{
-  kz_syscall_param_t param;
-  kz_syscall(KZ_SYSCALL_TYPE_SLEEP, &param);
-  return param.un.sleep.ret;
-}
-
-int kz_wakeup(kz_thread_id_t id)
-{
-  kz_syscall_param_t param;
-  param.un.wakeup.id = id;
-  kz_syscall(KZ_SYSCALL_TYPE_WAKEUP, &param);
-  return param.un.wakeup.ret;
-}
-
-kz_thread_id_t kz_getid(void)
-{
-  kz_syscall_param_t param;
-  kz_syscall(KZ_SYSCALL_TYPE_GETID, &param);
-  return param.un.getid.ret;
-}
-
-int kz_chpri(int priority)
-{
-  kz_syscall_param_t param;
-  param.un.chpri.priority = priority;
-  kz_syscall(KZ_SYSCALL_TYPE_CHPRI, &param);
-  return param.un.chpri.ret;
+  kz_trap(KZ_SYSCALL_TYPE_EXIT, 0, 0, 0);
 }
 
-void *kz_kmalloc(int size)
-{
-  kz_syscall_param_t param;
-  param.un.kmalloc.size = size;
-  kz_syscall(KZ_SYSCALL_TYPE_KMALLOC, &param);
-  return param.un.kmalloc.ret;
-}
-
-int kz_kmfree(void *p)
-{
-  kz_syscall_param_t param;
-  param.un.kmfree.p = p;
-  kz_syscall(KZ_SYSCALL_TYPE_KMFREE, &param);
-  return param.un.kmfree.ret;
-}
+#else /* KZ_SYSCALL_PARAM_ABI */
 
-int kz_send(kz_msgbox_id_t id, int size, char *p)
-{
-  kz_syscall_param_t param;
-  param.un.send.id = id;
-  param.un.send.size = size;
-  param.un.send.p = p;
-  kz_syscall(KZ_SYSCALL_TYPE_SEND, &param);
-  return param.un.send.ret;
-}
+/* 従来のパラメータ格納域渡しのシステム・コール */
+#define KZ_SYSCALL_STUB(rtype, name, NAME, n, ...)		\
+  rtype kz_##name(KZ_PARAMS(n, name, ##__VA_ARGS__))		\
+  {								\
+    kz_syscall_param_t param;					\
+    KZ_EACH(n, KZ_SETPARAM, name, ##__VA_ARGS__)		\
+    kz_syscall(KZ_SYSCALL_TYPE_##NAME, &param);			\
+    return param.un.name.ret;					\
+  }
 
-kz_thread_id_t kz_recv(kz_msgbox_id_t id, int *sizep, char **pp)
-{
-  kz_syscall_param_t param;
-  param.un.recv.id = id;
-  param.un.recv.sizep = sizep;
-  param.un.recv.pp = pp;
-  kz_syscall(KZ_SYSCALL_TYPE_RECV, &param);
-  return param.un.recv.ret;
-}
+#define KZ_SYSCALL_BLOCK_STUB KZ_SYSCALL_STUB
 
-int kz_setintr(softvec_type_t type, kz_handler_t handler)
+void kz_exit(void)
 {
-  kz_syscall_param_t param;
-  param.un.setintr.type = type;
-  param.un.setintr.handler = handler;
-  kz_syscall(KZ_SYSCALL_TYPE_SETINTR, &param);
-  return param.un.setintr.ret;
+  kz_syscall(KZ_SYSCALL_TYPE_EXIT, NULL);
 }
 
-/* サービス・コール */
-
-int kx_wakeup(kz_thread_id_t id)
-{
-  kz_syscall_param_t param;
-  param.un.wakeup.id = id;
-  kz_srvcall(KZ_SYSCALL_TYPE_WAKEUP, &param);
-  return param.un.wakeup.ret;
-}
+#endif /* KZ_SYSCALL_PARAM_ABI */
 
-void *kx_kmalloc(int size)
+/* カーネル情報ブロックを読むだけなので，トラップしない */
+kz_thread_id_t kz_getid(void)
 {
-  kz_syscall_param_t param;
-  param.un.kmalloc.size = size;
-  kz_srvcall(KZ_SYSCALL_TYPE_KMALLOC, &param);
-  return param.un.kmalloc.ret;
+  return KZ_INFO->id;
 }
 
-int kx_kmfree(void *p)
-{
-  kz_syscall_param_t param;
-  param.un.kmfree.p = p;
-  kz_srvcall(KZ_SYSCALL_TYPE_KMFREE, &param);
-  return param.un.kmfree.ret;
-}
+#define KZ_STUB_NONE(rtype, name, NAME, n, ...)
+#define KZ_STUB_NORET(rtype, name, NAME, n, ...)
+#define KZ_STUB_SYS(rtype, name, NAME, n, ...)			\
+  KZ_SYSCALL_STUB(rtype, name, NAME, n, ##__VA_ARGS__)
+#define KZ_STUB_SRV(rtype, name, NAME, n, ...)			\
+  KZ_SYSCALL_STUB(rtype, name, NAME, n, ##__VA_ARGS__)		\
+  KZ_SRVCALL_STUB(rtype, name, NAME, n, ##__VA_ARGS__)
 
-int kx_send(kz_msgbox_id_t id, int size, char *p)
-{
-  kz_syscall_param_t param;
-  param.un.send.id = id;
-  param.un.send.size = size;
-  param.un.send.p = p;
-  kz_srvcall(KZ_SYSCALL_TYPE_SEND, &param);
-  return param.un.send.ret;
-}
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...)		\
+  KZ_STUB_##stub(rtype, name, NAME, n, ##__VA_ARGS__)
+#define KZ_SYSCALL_BLOCK(rtype, name, NAME, stub, n, ...)	\
+  KZ_SYSCALL_BLOCK_STUB(rtype, name, NAME, n, ##__VA_ARGS__)
+#include "syscall_def.h"
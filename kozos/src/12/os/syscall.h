@@ -4,80 +4,73 @@
 #include "defines.h"
 #include "interrupt.h"
 
+/*
+ * syscall_def.h の引数リスト(型, 名前, 型, 名前, ...)の各引数に対して
+ * m(システム・コール名, 引数の番号(1～), 型, 名前) を展開する．
+ * 引数をカンマで区切る場合には，m の中で KZ_SEP_##i を使う．
+ */
+#define KZ_EACH(n, m, x, ...) KZ_EACH_##n(m, x, ##__VA_ARGS__)
+#define KZ_EACH_0(m, x)
+#define KZ_EACH_1(m, x, t1, a1) m(x, 1, t1, a1)
+#define KZ_EACH_2(m, x, t1, a1, t2, a2) m(x, 1, t1, a1) m(x, 2, t2, a2)
+#define KZ_EACH_3(m, x, t1, a1, t2, a2, t3, a3) \
+  m(x, 1, t1, a1) m(x, 2, t2, a2) m(x, 3, t3, a3)
+#define KZ_EACH_4(m, x, t1, a1, t2, a2, t3, a3, t4, a4) \
+  m(x, 1, t1, a1) m(x, 2, t2, a2) m(x, 3, t3, a3) m(x, 4, t4, a4)
+#define KZ_EACH_5(m, x, t1, a1, t2, a2, t3, a3, t4, a4, t5, a5) \
+  m(x, 1, t1, a1) m(x, 2, t2, a2) m(x, 3, t3, a3) m(x, 4, t4, a4) \
+  m(x, 5, t5, a5)
+#define KZ_EACH_7(m, x, t1, a1, t2, a2, t3, a3, t4, a4, t5, a5, t6, a6, t7, a7) \
+  m(x, 1, t1, a1) m(x, 2, t2, a2) m(x, 3, t3, a3) m(x, 4, t4, a4) \
+  m(x, 5, t5, a5) m(x, 6, t6, a6) m(x, 7, t7, a7)
+
+#define KZ_SEP_1
+#define KZ_SEP_2 ,
+#define KZ_SEP_3 ,
+#define KZ_SEP_4 ,
+#define KZ_SEP_5 ,
+#define KZ_SEP_6 ,
+#define KZ_SEP_7 ,
+
 /* システム・コール番号の定義 */
 typedef enum {
-  KZ_SYSCALL_TYPE_RUN = 0,
-  KZ_SYSCALL_TYPE_EXIT,
-  KZ_SYSCALL_TYPE_WAIT,
-  KZ_SYSCALL_TYPE_SLEEP,
-  KZ_SYSCALL_TYPE_WAKEUP,
-  KZ_SYSCALL_TYPE_GETID,
-  KZ_SYSCALL_TYPE_CHPRI,
-  KZ_SYSCALL_TYPE_KMALLOC,
-  KZ_SYSCALL_TYPE_KMFREE,
-  KZ_SYSCALL_TYPE_SEND,
-  KZ_SYSCALL_TYPE_RECV,
-  KZ_SYSCALL_TYPE_SETINTR,
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) KZ_SYSCALL_TYPE_##NAME,
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
+  KZ_SYSCALL_TYPE_NUM
 } kz_syscall_type_t;
 
+typedef struct _kz_batch kz_batch_t;
+
 /* システム・コール呼び出し時のパラメータ格納域の定義 */
+#define KZ_FIELD(x, i, t, a) t a;
 typedef struct {
   union {
-    struct {
-      kz_func_t func;
-      char *name;
-      int priority;
-      int stacksize;
-      int argc;
-      char **argv;
-      kz_thread_id_t ret;
-    } run;
-    struct {
-      int dummy;
-    } exit;
-    struct {
-      int ret;
-    } wait;
-    struct {
-      int ret;
-    } sleep;
-    struct {
-      kz_thread_id_t id;
-      int ret;
-    } wakeup;
-    struct {
-      kz_thread_id_t ret;
-    } getid;
-    struct {
-      int priority;
-      int ret;
-    } chpri;
-    struct {
-      int size;
-      void *ret;
-    } kmalloc;
-    struct {
-      char *p;
-      int ret;
-    } kmfree;
-    struct {
-      kz_msgbox_id_t id;
-      int size;
-      char *p;
-      int ret;
-    } send;
-    struct {
-      kz_msgbox_id_t id;
-      int *sizep;
-      char **pp;
-      kz_thread_id_t ret;
-    } recv;
-    struct{
-      softvec_type_t type;
-      kz_handler_t handler;
-      int ret;
-    } setintr;
+#define KZ_SYSCALL(rtype, name, NAME, stub, n, ...) \
+    struct {					    \
+      KZ_EACH(n, KZ_FIELD, name, ##__VA_ARGS__) \
+      rtype ret;					    \
+    } name;
+#define KZ_SYSCALL_BLOCK KZ_SYSCALL
+#include "syscall_def.h"
+#undef KZ_SYSCALL
+#undef KZ_SYSCALL_BLOCK
   } un;
 } kz_syscall_param_t;
+#undef KZ_FIELD
+
+/* kz_batch() でまとめて実行するシステム・コール */
+struct _kz_batch {
+  kz_syscall_type_t type;
+  kz_syscall_param_t param; /* 引数を設定しておき，戻り値もここに返る */
+  /*
+   * 呼び出し側が ops[i] のように配列で扱うので，kz_msgbox と同様に
+   * サイズを２の累乗にする．(現在はダミー・メンバで32バイトにしている．
+   * kz_syscall_param_t の大きさが変わった場合には調整すること)
+   */
+  int dummy[3];
+};
 
 #endif
@@ -0,0 +1,68 @@
+/*
+ * システム・コールの定義
+ * このファイルは複数回インクルードされ，KZ_SYSCALL() の定義に応じて
+ * システム・コール番号，パラメータ格納域，ライブラリ関数(kz_xxx(),
+ * kx_xxx())，カーネル内の処理関数のテーブルを生成する．
+ * (このためインクルード・ガードは付けない)
+ *
+ * KZ_SYSCALL(戻り値の型, 名前, 番号, スタブ, 引数の数, 引数の型, 引数名, ...)
+ *   名前   : kz_xxx() と thread_xxx() の xxx の部分
+ *   番号   : KZ_SYSCALL_TYPE_XXX の XXX の部分
+ *   スタブ : SYS  ... システム・コール(kz_xxx())を生成する
+ *            SRV  ... システム・コールとサービス・コール(kx_xxx())を生成する
+ *            NONE ... 生成しない(syscall.c に直接記述する)
+ *            NORET... NONE と同じで，さらにカーネル内で戻り値を格納しない
+ *                     (kz_exit() はパラメータ格納域を渡さない)
+ * 引数はレジスタ(er1～er3)で渡すので３つまで．それ以上の場合は
+ * KZ_SYSCALL_BLOCK() で定義し，パラメータ格納域をまとめて渡す．
+ * 定義する順番がシステム・コール番号になる．
+ */
+KZ_SYSCALL_BLOCK(kz_thread_id_t, run, RUN, SYS, 7,
+		 kz_func_t, func, char *, name, int, priority, int, quantum,
+		 int, stacksize, int, argc, char **, argv)
+KZ_SYSCALL(int, exit, EXIT, NORET, 0)
+KZ_SYSCALL(int, wait, WAIT, SYS, 0)
+KZ_SYSCALL(int, sleep, SLEEP, SYS, 1, int, msec)
+KZ_SYSCALL(int, wakeup, WAKEUP, SRV, 1, kz_thread_id_t, id)
+KZ_SYSCALL(kz_thread_id_t, getid, GETID, NONE, 0) /* KZ_INFO を読む */
+KZ_SYSCALL(int, chpri, CHPRI, SYS, 1, int, priority)
+KZ_SYSCALL(void *, kmalloc, KMALLOC, SRV, 1, int, size)
+KZ_SYSCALL(int, kmfree, KMFREE, SRV, 1, void *, p)
+KZ_SYSCALL(int, send, SEND, SRV, 3, kz_msgbox_id_t, id, int, size, char *, p)
+KZ_SYSCALL(kz_thread_id_t, recv, RECV, SYS, 3,
+	   kz_msgbox_id_t, id, int *, sizep, char **, pp)
+KZ_SYSCALL(int, setintr, SETINTR, SYS, 2,
+	   softvec_type_t, type, kz_handler_t, handler)
+KZ_SYSCALL(int, getstat, GETSTAT, SYS, 1, kz_stat_t *, stat)
+KZ_SYSCALL(int, mutex_lock, MUTEX_LOCK, SYS, 1, kz_mutex_id_t, id)
+KZ_SYSCALL(int, mutex_unlock, MUTEX_UNLOCK, SYS, 1, kz_mutex_id_t, id)
+KZ_SYSCALL(int, sem_wait, SEM_WAIT, SYS, 1, kz_sem_id_t, id)
+KZ_SYSCALL(int, sem_post, SEM_POST, SRV, 1, kz_sem_id_t, id)
+KZ_SYSCALL(uint16, flag_wait, FLAG_WAIT, SYS, 3,
+	   kz_flag_id_t, id, uint16, pattern, int, mode)
+KZ_SYSCALL(int, flag_set, FLAG_SET, SRV, 2, kz_flag_id_t, id, uint16, pattern)
+KZ_SYSCALL(int, flag_clear, FLAG_CLEAR, SYS, 2,
+	   kz_flag_id_t, id, uint16, pattern)
+KZ_SYSCALL(int, getstack, GETSTACK, SYS, 2, kz_stackinfo_t *, info, int, num)
+KZ_SYSCALL(int, send_copy, SEND_COPY, SRV, 3,
+	   kz_msgbox_id_t, id, int, size, char *, p)
+KZ_SYSCALL(kz_thread_id_t, recv_copy, RECV_COPY, SYS, 3,
+	   kz_msgbox_id_t, id, int *, sizep, char **, pp)
+KZ_SYSCALL(kz_thread_id_t, tryrecv, TRYRECV, SYS, 3,
+	   kz_msgbox_id_t, id, int *, sizep, char **, pp)
+KZ_SYSCALL_BLOCK(kz_thread_id_t, recv_timeout, RECV_TIMEOUT, SYS, 4,
+		 kz_msgbox_id_t, id, int *, sizep, char **, pp, int, msec)
+KZ_SYSCALL(int, msgbox_setlimit, MSGBOX_SETLIMIT, SYS, 2,
+	   kz_msgbox_id_t, id, int, limit)
+KZ_SYSCALL(int, msgbox_getinfo, MSGBOX_GETINFO, SYS, 2,
+	   kz_msgbox_id_t, id, kz_msgboxinfo_t *, info)
+KZ_SYSCALL(int, msgbox_create, MSGBOX_CREATE, SYS, 1, int, limit)
+KZ_SYSCALL(int, msgbox_delete, MSGBOX_DELETE, SYS, 1, kz_msgbox_id_t, id)
+KZ_SYSCALL_BLOCK(kz_thread_id_t, recv_any, RECV_ANY, SYS, 5,
+		 int, num, kz_msgbox_id_t *, ids, kz_msgbox_id_t *, idp,
+		 int *, sizep, char **, pp)
+KZ_SYSCALL(int, call, CALL, SYS, 3, kz_msgbox_id_t, id, int, size, char **, pp)
+KZ_SYSCALL(int, reply, REPLY, SYS, 3, kz_thread_id_t, id, int, size, char *, p)
+KZ_SYSCALL(int, batch, BATCH, SYS, 2, kz_batch_t *, ops, int, num)
+KZ_SYSCALL_BLOCK(int, send_pri, SEND_PRI, SYS, 4,
+		 kz_msgbox_id_t, id, int, size, char *, p, int, pri)
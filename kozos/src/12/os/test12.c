@@ -0,0 +1,65 @@
+#include "defines.h"
+#include "kozos.h"
+#include "timer.h"
+#include "lib.h"
+#include "test12.h"
+
+/* 計測結果を初期化して，計測用のカウンタを開始する */
+void bench_init(bench_t *bp, int shift)
+{
+  bp->shift = shift;
+  bp->min   = 0xffff;
+  bp->max   = 0;
+  bp->total = 0;
+  timer_start_free(BENCH_TIMER_INDEX);
+}
+
+/* 区間の開始時のカウンタの値 */
+uint16 bench_count(void)
+{
+  return timer_get_count(BENCH_TIMER_INDEX);
+}
+
+/* start からのカウント数を計測結果に加える(カウンタの一周以内であること) */
+void bench_add(bench_t *bp, uint16 start)
+{
+  uint16 count = timer_get_count(BENCH_TIMER_INDEX) - start;
+
+  if (count < bp->min) bp->min = count;
+  if (count > bp->max) bp->max = count;
+  bp->total += count;
+}
+
+/*
+ * 計測結果を出力する．平均は合計を計測回数のシフトで割って求める．
+ * (-mh では32ビットの除算がライブラリ呼び出しになるため)
+ */
+void bench_print(char *name, bench_t *bp)
+{
+  puts(name);
+  puts(" min:");
+  putxval(bp->min, 4);
+  puts(" max:");
+  putxval(bp->max, 4);
+  puts(" avg:");
+  putxval(bp->total >> bp->shift, 4);
+  puts("\n");
+}
+
+/*
+ * ベンチマークを順に実行する(command の bench コマンドで起動する)．
+ * 途中でスリープすると command などの低優先度のスレッドも動くので，
+ * 別々のスレッドにせず，１つのスレッドから順に呼び出す．
+ */
+int test12_main(int argc, char *argv[])
+{
+  test12_1_main(argc, argv); /* ディスパッチ */
+  test12_2_main(argc, argv); /* ミューテックスの競合 */
+  test12_3_main(argc, argv); /* スレッドの生成・終了 */
+  test12_4_main(argc, argv); /* 要求と返信の往復 */
+  test12_5_main(argc, argv); /* 割込み出口の高速パス */
+  test12_6_main(argc, argv); /* システム・コールの呼び出し方 */
+  test12_7_main(argc, argv); /* 送信から受信までの遅延 */
+  test12_8_main(argc, argv); /* 小さなメッセージのコピー渡し */
+  return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef _TEST12_H_INCLUDED_
+#define _TEST12_H_INCLUDED_
+
+/*
+ * ベンチマーク・スレッド(test12_x.c)の共通部分．
+ * フリーラン・カウンタ(φ/8 = 2.5MHz，1カウントが 0.4 マイクロ秒)で
+ * 区間ごとのカウント数を計り，最小・最大・平均を出力する．
+ */
+#define BENCH_TIMER_INDEX 1 /* 計測に使うタイマのチャネル(0はティック用) */
+#define BENCH_LOOP_SHIFT  8 /* 計測回数(2のべき乗で，平均をシフトで求める) */
+
+typedef struct {
+  int shift;    /* 計測回数は (1 << shift) 回 */
+  uint16 min;   /* 最小のカウント数 */
+  uint16 max;   /* 最大のカウント数 */
+  uint32 total; /* カウント数の合計 */
+} bench_t;
+
+void bench_init(bench_t *bp, int shift);
+uint16 bench_count(void);
+void bench_add(bench_t *bp, uint16 start);
+void bench_print(char *name, bench_t *bp);
+
+#endif
@@ -0,0 +1,61 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * ディスパッチのベンチマーク．
+ * 同じ優先度の２つのスレッドで kz_wait() により切替えを繰り返し，
+ * １往復(２回のディスパッチ)のカウント数を計る．
+ * 優先度の高いレディー・キューがすべて空になるように，最も低い
+ * ユーザ優先度(アイドル・スレッドの１つ上)で実行する．線形探索ならば
+ * レディー・キューをほぼすべて探すことになる．
+ * Makefile の PRIORITY_NUM を 16/32/64 に変え，KZ_SCHED_LINEAR の
+ * 有無(線形探索とビットマップ)で比べる．
+ */
+
+#define BENCH_PRIORITY (PRIORITY_NUM - 2)
+
+static volatile int done;
+
+static int test12_1_sub(int argc, char *argv[])
+{
+  while (!done)
+    kz_wait();
+  return 0;
+}
+
+int test12_1_main(int argc, char *argv[])
+{
+  bench_t bench;
+  uint16 start;
+  int i, pri = KZ_INFO->priority;
+
+  puts("test12_1 started. PRIORITY_NUM:");
+  putxval(PRIORITY_NUM, 0);
+#ifdef KZ_SCHED_LINEAR
+  puts(" (linear)\n");
+#else
+  puts(" (bitmap)\n");
+#endif
+
+  done = 0;
+  kz_chpri(BENCH_PRIORITY);
+  kz_run(test12_1_sub, "test12_1s", BENCH_PRIORITY, 0, 0x100, 0, NULL);
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    kz_wait(); /* test12_1_sub に切替わり，すぐに戻ってくる */
+    bench_add(&bench, start);
+  }
+  bench_print("dispatch x2", &bench);
+
+  done = 1;
+  kz_wait(); /* test12_1_sub を終了させる */
+  kz_chpri(pri);
+
+  puts("test12_1 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * ミューテックスの競合のベンチマーク．
+ * 低優先度のスレッドが資源を確保している間に，高優先度のスレッド(これ)が
+ * 獲得を要求し，獲得できるまでのブロック時間を計る．その間は中優先度の
+ * スレッドが CPU を使い続けるので，優先度継承の無いセマフォでは
+ * その分だけ待たされる(優先度逆転)．セマフォと比べて出力する．
+ *
+ * スレッド間の同期にはイベント・フラグを使う．セットしたビットは
+ * 待ち側が受け取るまで残るので，相手がまだ待ちに入っていなくても
+ * 起床を取りこぼさない．
+ */
+
+#define LOCK_LOOP 0x100 /* 低優先度のスレッドが資源を確保している時間 */
+#define BUSY_LOOP 0x400 /* 中優先度のスレッドが CPU を使い続ける時間 */
+
+#define START_LOW (1 << 0) /* 低優先度のスレッドの開始 */
+#define START_MID (1 << 1) /* 中優先度のスレッドの開始 */
+#define LOCKED    (1 << 2) /* 低優先度のスレッドが資源を確保した */
+#define PARK_LOW  (1 << 3) /* 低優先度のスレッドが１回分を終えた */
+#define PARK_MID  (1 << 4) /* 中優先度のスレッドが１回分を終えた */
+
+static volatile int use_mutex;
+static volatile int done;
+
+static void lock(void)
+{
+  if (use_mutex)
+    kz_mutex_lock(MUTEX_ID_MUTEX1);
+  else
+    kz_sem_wait(SEM_ID_SEM1);
+}
+
+static void unlock(void)
+{
+  if (use_mutex)
+    kz_mutex_unlock(MUTEX_ID_MUTEX1);
+  else
+    kz_sem_post(SEM_ID_SEM1);
+}
+
+static void busy(int n)
+{
+  volatile int i;
+  for (i = 0; i < n; i++)
+    ;
+}
+
+/* 低優先度のスレッド．資源を確保してから，高優先度のスレッドに知らせる */
+static int test12_2_low(int argc, char *argv[])
+{
+  while (1) {
+    kz_flag_wait(FLAG_ID_FLAG1, START_LOW, KZ_FLAG_OR | KZ_FLAG_CLEAR);
+    if (done)
+      break;
+    lock();
+    kz_flag_set(FLAG_ID_FLAG1, LOCKED); /* ここで高優先度のスレッドに切替わる */
+    busy(LOCK_LOOP);
+    unlock();
+    kz_flag_set(FLAG_ID_FLAG1, PARK_LOW);
+  }
+  return 0;
+}
+
+/* 中優先度のスレッド．開始されると，しばらく CPU を使い続ける */
+static int test12_2_mid(int argc, char *argv[])
+{
+  while (1) {
+    kz_flag_wait(FLAG_ID_FLAG1, START_MID, KZ_FLAG_OR | KZ_FLAG_CLEAR);
+    if (done)
+      break;
+    busy(BUSY_LOOP);
+    kz_flag_set(FLAG_ID_FLAG1, PARK_MID);
+  }
+  return 0;
+}
+
+static void measure(char *name)
+{
+  bench_t bench;
+  uint16 start;
+  int i;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    /* 前回の分を終えて，低・中優先度のスレッドが待ちに戻るのを待つ */
+    kz_flag_wait(FLAG_ID_FLAG1, PARK_LOW | PARK_MID,
+                 KZ_FLAG_AND | KZ_FLAG_CLEAR);
+    kz_flag_set(FLAG_ID_FLAG1, START_LOW);
+    kz_flag_wait(FLAG_ID_FLAG1, LOCKED, KZ_FLAG_OR | KZ_FLAG_CLEAR);
+    kz_flag_set(FLAG_ID_FLAG1, START_MID);
+    start = bench_count();
+    lock();
+    bench_add(&bench, start);
+    unlock();
+  }
+  bench_print(name, &bench);
+}
+
+int test12_2_main(int argc, char *argv[])
+{
+  int pri = KZ_INFO->priority;
+
+  puts("test12_2 started.\n");
+
+  done = 0;
+  kz_flag_set(FLAG_ID_FLAG1, PARK_LOW | PARK_MID); /* 最初の回の分 */
+  kz_run(test12_2_low, "test12_2l", pri + 4, 0, 0x100, 0, NULL);
+  kz_run(test12_2_mid, "test12_2m", pri + 2, 0, 0x100, 0, NULL);
+
+  use_mutex = 1;
+  measure("mutex blocking");
+
+  use_mutex = 0;
+  kz_sem_post(SEM_ID_SEM1); /* 資源１つのセマフォとして使う */
+  measure("sem blocking");
+  kz_sem_wait(SEM_ID_SEM1);
+
+  /*
+   * 低・中優先度のスレッドを終了させる．一時的に優先度を下げて，
+   * 終了するまで実行させてから戻る．
+   */
+  kz_flag_wait(FLAG_ID_FLAG1, PARK_LOW | PARK_MID,
+               KZ_FLAG_AND | KZ_FLAG_CLEAR);
+  done = 1;
+  kz_flag_set(FLAG_ID_FLAG1, START_LOW | START_MID);
+  kz_chpri(pri + 5);
+  kz_chpri(pri);
+
+  puts("test12_2 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * スレッドの生成・終了のベンチマーク．
+ * 優先度の高いスレッドを kz_run() で生成すると，すぐに実行されて
+ * 終了するので，生成から終了して戻るまでのカウント数を計る．
+ * 同じ TCB とスタックの再利用を約１万回(2の13乗回)繰り返す．
+ * 終了メッセージをシリアルに出力すると，その時間(9600bps で1行あたり
+ * 十数ミリ秒)が計測を支配するので，KZ_EXIT_QUIET で出力を止めて計る．
+ */
+
+#define CHURN_SHIFT 13
+
+static int test12_3_sub(int argc, char *argv[])
+{
+  return 0;
+}
+
+int test12_3_main(int argc, char *argv[])
+{
+  bench_t bench;
+  uint16 start;
+  int i, pri = KZ_INFO->priority;
+
+  puts("test12_3 started.\n");
+
+  bench_init(&bench, CHURN_SHIFT);
+  for (i = 0; i < (1 << CHURN_SHIFT); i++) {
+    start = bench_count();
+    kz_run(test12_3_sub, "test12_3s", pri - 1, 0, 0x100, 0, NULL);
+    bench_add(&bench, start);
+  }
+  bench_print("run+exit", &bench);
+
+  puts("test12_3 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * 要求と返信の往復のベンチマーク．
+ * 同じ優先度のサーバ・スレッドとの１往復のカウント数を，kz_call() と
+ * kz_reply() による場合(２回のトラップ)と，要求と返信に別々の
+ * メッセージ・ボックスを使う kz_send() と kz_recv() の場合(４回)で比べる．
+ */
+
+static volatile int use_call;
+static kz_msgbox_id_t reqbox, repbox;
+
+static int test12_4_sub(int argc, char *argv[])
+{
+  kz_thread_id_t id;
+  int size;
+  char *p;
+
+  while (1) {
+    id = kz_recv(reqbox, &size, &p);
+    if (size == 0) /* 終了 */
+      break;
+    if (use_call)
+      kz_reply(id, size, p);
+    else
+      kz_send(repbox, size, p);
+  }
+  return 0;
+}
+
+static void measure(char *name)
+{
+  bench_t bench;
+  uint16 start;
+  int i, size;
+  char *p;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    if (use_call) {
+      p = "req";
+      kz_call(reqbox, 4, &p);
+    } else {
+      kz_send(reqbox, 4, "req");
+      kz_recv(repbox, &size, &p);
+    }
+    bench_add(&bench, start);
+  }
+  bench_print(name, &bench);
+}
+
+int test12_4_main(int argc, char *argv[])
+{
+  int req, rep;
+
+  puts("test12_4 started.\n");
+
+  req = kz_msgbox_create(0);
+  rep = kz_msgbox_create(0);
+  if ((req < 0) || (rep < 0)) {
+    puts("test12_4 cannot create msgbox.\n");
+    if (req >= 0) kz_msgbox_delete(req);
+    if (rep >= 0) kz_msgbox_delete(rep);
+    return -1;
+  }
+  reqbox = req;
+  repbox = rep;
+  kz_run(test12_4_sub, "test12_4s", KZ_INFO->priority, 0, 0x100, 0, NULL);
+
+  use_call = 1;
+  measure("call/reply");
+
+  use_call = 0;
+  measure("send/recv");
+
+  kz_send(reqbox, 0, NULL);
+  kz_wait(); /* サーバ・スレッドを終了させる */
+  kz_msgbox_delete(reqbox);
+  kz_msgbox_delete(repbox);
+
+  puts("test12_4 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * 割込み出口の高速パスのベンチマーク．
+ * 切替えの起きない軽いシステム・コールの１回あたりのカウント数を計る．
+ * KZ_NO_FASTPATH の有無(常に dispatch() で戻るか，そのまま戻るか)で
+ * 比べる．kz_getid() はトラップせずに KZ_INFO を読むだけなので，
+ * どちらでも同じになる(比較の基準として計る)．
+ * kz_wait() は同じ優先度に他のスレッドが無いので，自分に戻ってくる．
+ */
+
+static void measure_getid(void)
+{
+  bench_t bench;
+  uint16 start;
+  int i;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    kz_getid();
+    bench_add(&bench, start);
+  }
+  bench_print("getid", &bench);
+}
+
+static void measure_kmalloc(void)
+{
+  bench_t bench;
+  uint16 start;
+  int i;
+  char *p;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    p = kz_kmalloc(16);
+    kz_kmfree(p);
+    bench_add(&bench, start);
+  }
+  bench_print("kmalloc+kmfree", &bench);
+}
+
+static void measure_wait(void)
+{
+  bench_t bench;
+  uint16 start;
+  int i;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    kz_wait();
+    bench_add(&bench, start);
+  }
+  bench_print("wait", &bench);
+}
+
+int test12_5_main(int argc, char *argv[])
+{
+  puts("test12_5 started.");
+#ifdef KZ_NO_FASTPATH
+  puts(" (dispatch)\n");
+#else
+  puts(" (fastpath)\n");
+#endif
+
+  measure_getid();
+  measure_kmalloc();
+  measure_wait();
+
+  puts("test12_5 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * システム・コールの呼び出し方のベンチマーク．
+ * 切替えの起きないシステム・コールの１回あたりのカウント数を計る．
+ * 同じものを KZ_DIRECTCALL の有無(トラップ命令による呼び出しと，
+ * カーネル関数の直接の呼び出し)でビルドして比べる．
+ * セマフォとミューテックスは他で使っていない SEM2 と MUTEX2 を使い，
+ * 獲得と解放を対にして待ちが起きないようにする．
+ */
+
+static void measure(char *name, int op)
+{
+  bench_t bench;
+  uint16 start;
+  int i;
+  char *p;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    switch (op) {
+    case 0:
+      p = kz_kmalloc(16);
+      kz_kmfree(p);
+      break;
+    case 1:
+      kz_sem_post(SEM_ID_SEM2);
+      kz_sem_wait(SEM_ID_SEM2);
+      break;
+    case 2:
+      kz_mutex_lock(MUTEX_ID_MUTEX2);
+      kz_mutex_unlock(MUTEX_ID_MUTEX2);
+      break;
+    default:
+      kz_wait(); /* 同じ優先度に他のスレッドが無いので切替わらない */
+      break;
+    }
+    bench_add(&bench, start);
+  }
+  bench_print(name, &bench);
+}
+
+int test12_6_main(int argc, char *argv[])
+{
+  puts("test12_6 started.");
+#ifdef KZ_DIRECTCALL
+  puts(" (direct)\n");
+#else
+  puts(" (trap)\n");
+#endif
+
+  /* wait 以外は２回のシステム・コール */
+  measure("kmalloc+kmfree", 0);
+  measure("sem post+wait", 1);
+  measure("mutex lock+unlock", 2);
+  measure("wait", 3);
+
+  puts("test12_6 exit.\n");
+
+  return 0;
+}
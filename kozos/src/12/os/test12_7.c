@@ -0,0 +1,73 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * メッセージの送信から受信までの遅延のベンチマーク．
+ * kz_send() の直前にカウンタを読み，受信待ちのスレッドが kz_recv() から
+ * 戻った直後までのカウント数を受信側で計る．
+ * 受信側の優先度が高ければ，送信のトラップのまま受信側に切替わる．
+ * 同じ優先度ならば，送信側が kz_wait() で手放すまで受信側は動けない．
+ */
+
+static kz_msgbox_id_t msgbox;
+static bench_t bench;
+static volatile uint16 stamp;
+
+static int test12_7_sub(int argc, char *argv[])
+{
+  int size;
+  char *p;
+
+  while (1) {
+    kz_recv(msgbox, &size, &p);
+    if (size == 0) /* 終了 */
+      break;
+    bench_add(&bench, stamp);
+  }
+  return 0;
+}
+
+static void measure(char *name, int priority)
+{
+  int i;
+
+  /* 受信側を起動して，受信待ちに入るまで実行させる */
+  kz_run(test12_7_sub, "test12_7s", priority, 0, 0x100, 0, NULL);
+  kz_wait();
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    stamp = bench_count();
+    kz_send(msgbox, 4, "msg");
+    kz_wait(); /* 同じ優先度の場合は，ここで受信側に切替わる */
+  }
+  bench_print(name, &bench);
+
+  kz_send(msgbox, 0, NULL);
+  kz_wait(); /* 受信側を終了させる */
+}
+
+int test12_7_main(int argc, char *argv[])
+{
+  int id, pri = KZ_INFO->priority;
+
+  puts("test12_7 started.\n");
+
+  id = kz_msgbox_create(0);
+  if (id < 0) {
+    puts("test12_7 cannot create msgbox.\n");
+    return -1;
+  }
+  msgbox = id;
+
+  measure("send->recv (higher)", pri - 1);
+  measure("send->recv (same)", pri);
+
+  kz_msgbox_delete(msgbox);
+
+  puts("test12_7 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "test12.h"
+
+/*
+ * 小さなメッセージの往復のベンチマーク．
+ * 同じ優先度のエコー・スレッドと３バイトのメッセージを往復させ，
+ * kz_send_copy()/kz_recv_copy() によるコピー渡しと，kz_kmalloc() した
+ * 領域を kz_send()/kz_recv() で渡して受信側が kz_kmfree() する
+ * ポインタ渡し(command.c の send_use() と同じ使い方)とで比べる．
+ * エコー・スレッドは，コピー渡しとポインタ渡しを同じ回数ずつ処理して終了する．
+ */
+
+#define MSG_SIZE 3
+
+static kz_msgbox_id_t reqbox, repbox;
+
+static int test12_8_sub(int argc, char *argv[])
+{
+  char buf[KZ_MSG_INLINE_SIZE];
+  int i, size;
+  char *p, *q;
+
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    p = buf;
+    kz_recv_copy(reqbox, &size, &p);
+    kz_send_copy(repbox, size, buf);
+  }
+
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    kz_recv(reqbox, &size, &p);
+    q = kz_kmalloc(size);
+    memcpy(q, p, size);
+    kz_kmfree(p);
+    kz_send(repbox, size, q);
+  }
+
+  return 0;
+}
+
+static void measure_copy(void)
+{
+  bench_t bench;
+  uint16 start;
+  char buf[KZ_MSG_INLINE_SIZE];
+  int i, size;
+  char *p;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    kz_send_copy(reqbox, MSG_SIZE, "cmd");
+    p = buf;
+    kz_recv_copy(repbox, &size, &p);
+    bench_add(&bench, start);
+  }
+  bench_print("send_copy", &bench);
+}
+
+static void measure_pointer(void)
+{
+  bench_t bench;
+  uint16 start;
+  int i, size;
+  char *p;
+
+  bench_init(&bench, BENCH_LOOP_SHIFT);
+  for (i = 0; i < (1 << BENCH_LOOP_SHIFT); i++) {
+    start = bench_count();
+    p = kz_kmalloc(MSG_SIZE);
+    memcpy(p, "cmd", MSG_SIZE);
+    kz_send(reqbox, MSG_SIZE, p);
+    kz_recv(repbox, &size, &p);
+    kz_kmfree(p);
+    bench_add(&bench, start);
+  }
+  bench_print("kmalloc+send", &bench);
+}
+
+int test12_8_main(int argc, char *argv[])
+{
+  int req, rep;
+
+  puts("test12_8 started.\n");
+
+  req = kz_msgbox_create(0);
+  rep = kz_msgbox_create(0);
+  if ((req < 0) || (rep < 0)) {
+    puts("test12_8 cannot create msgbox.\n");
+    if (req >= 0) kz_msgbox_delete(req);
+    if (rep >= 0) kz_msgbox_delete(rep);
+    return -1;
+  }
+  reqbox = req;
+  repbox = rep;
+
+  kz_run(test12_8_sub, "test12_8s", KZ_INFO->priority, 0, 0x100, 0, NULL);
+  kz_wait(); /* エコー・スレッドを受信待ちに入れる */
+
+  measure_copy();
+  measure_pointer();
+
+  kz_wait(); /* エコー・スレッドの終了を待つ */
+  kz_msgbox_delete(reqbox);
+  kz_msgbox_delete(repbox);
+
+  puts("test12_8 exit.\n");
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "defines.h"
+#include "timer.h"
+
+#define TIMER_NUM 3
+
+#define H8_3069F_TMR16	((volatile struct h8_3069f_tmr16 *)0xffff60)
+#define H8_3069F_TMR16_CH0	((volatile struct h8_3069f_tmr16_ch *)0xffff68)
+#define H8_3069F_TMR16_CH1	((volatile struct h8_3069f_tmr16_ch *)0xffff70)
+#define H8_3069F_TMR16_CH2	((volatile struct h8_3069f_tmr16_ch *)0xffff78)
+
+/* 全チャネル共通のレジスタ */
+struct h8_3069f_tmr16 {
+	volatile uint8 tstr;
+	volatile uint8 tsnc;
+	volatile uint8 tmdr;
+	volatile uint8 tolr;
+	volatile uint8 tisra;
+	volatile uint8 tisrb;
+	volatile uint8 tisrc;
+};
+
+/* チャネルごとのレジスタ */
+struct h8_3069f_tmr16_ch {
+	volatile uint8 tcr;
+	volatile uint8 tior;
+	volatile uint16 tcnt;
+	volatile uint16 gra;
+	volatile uint16 grb;
+};
+
+#define H8_3069F_TMR16_TCR_TPSC_PER1	(0<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER2	(1<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER4	(2<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER8	(3<<0)
+#define H8_3069F_TMR16_TCR_CKEG_RISE	(0<<3)
+#define H8_3069F_TMR16_TCR_CCLR_DISABLE	(0<<5)
+#define H8_3069F_TMR16_TCR_CCLR_GRA	(1<<5)
+#define H8_3069F_TMR16_TCR_CCLR_GRB	(2<<5)
+
+#define H8_3069F_TMR16_TIOR_DISABLE	(0<<0)
+
+static struct {
+	volatile struct h8_3069f_tmr16_ch *ch;
+	uint8 str;   /* TSTRのカウント開始ビット */
+	uint8 imfa;  /* TISRAのコンペア・マッチ・フラグ */
+	uint8 imiea; /* TISRAの割込み許可ビット */
+} regs[TIMER_NUM] = {
+	{H8_3069F_TMR16_CH0, (1<<0), (1<<0), (1<<4)},
+	{H8_3069F_TMR16_CH1, (1<<1), (1<<1), (1<<5)},
+	{H8_3069F_TMR16_CH2, (1<<2), (1<<2), (1<<6)},
+};
+
+
+
+/* GRAのコンペア・マッチでカウンタをクリアする周期タイマとして開始する */
+int timer_start(int index,int msec){
+	volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+	volatile struct h8_3069f_tmr16_ch *ch = regs[index].ch;
+
+	if(msec <= 0 || msec > TIMER_MSEC_MAX){
+		return -1;
+	}
+
+	tmr->tstr &= ~regs[index].str;
+
+	ch->tcr = H8_3069F_TMR16_TCR_CCLR_GRA | H8_3069F_TMR16_TCR_CKEG_RISE |
+		H8_3069F_TMR16_TCR_TPSC_PER8;
+	ch->tior = H8_3069F_TMR16_TIOR_DISABLE;
+	ch->tcnt = 0;
+	/*
+	 * msec は TIMER_MSEC_MAX 以下なので16ビットで収まる．
+	 * (32ビットの乗算は libgcc のヘルパ呼び出しになるので使わない)
+	 */
+	ch->gra = (uint16)msec * TIMER_COUNT_PER_MSEC - 1;
+
+	tmr->tisra &= ~regs[index].imfa;
+	tmr->tisra |= regs[index].imiea;
+
+	tmr->tstr |= regs[index].str;
+
+	return 0;
+}
+
+/*
+ * 割込みを使わずに，0xffff から0に戻るだけのフリーラン・カウンタとして
+ * 開始する．(ベンチマークでの時間計測用．26ミリ秒までの区間を計れる)
+ */
+int timer_start_free(int index){
+	volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+	volatile struct h8_3069f_tmr16_ch *ch = regs[index].ch;
+
+	tmr->tstr &= ~regs[index].str;
+
+	ch->tcr = H8_3069F_TMR16_TCR_CCLR_DISABLE | H8_3069F_TMR16_TCR_CKEG_RISE |
+		H8_3069F_TMR16_TCR_TPSC_PER8;
+	ch->tior = H8_3069F_TMR16_TIOR_DISABLE;
+	ch->tcnt = 0;
+
+	tmr->tisra &= ~(regs[index].imfa | regs[index].imiea);
+
+	tmr->tstr |= regs[index].str;
+
+	return 0;
+}
+
+int timer_is_expired(int index){
+	volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+	return (tmr->tisra & regs[index].imfa) ? 1 : 0;
+}
+
+void timer_expire(int index){
+	volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+	tmr->tisra &= ~regs[index].imfa;
+}
+
+void timer_cancel(int index){
+	volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+	tmr->tstr &= ~regs[index].str;
+	tmr->tisra &= ~(regs[index].imfa | regs[index].imiea);
+}
+
+uint16 timer_get_count(int index){
+	volatile struct h8_3069f_tmr16_ch *ch = regs[index].ch;
+	return ch->tcnt;
+}
+
+void timer_set_count(int index,uint16 count){
+	volatile struct h8_3069f_tmr16_ch *ch = regs[index].ch;
+	ch->tcnt = count;
+}
+
+/* カウンタを止めずに周期を変更する(ティックレス・アイドル用) */
+void timer_set_period(int index,uint16 count){
+	volatile struct h8_3069f_tmr16_ch *ch = regs[index].ch;
+	ch->gra = count - 1;
+}
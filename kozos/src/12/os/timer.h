@@ -0,0 +1,18 @@
+#ifndef _TIMER_H_INCLUDE_
+#define _TIMER_H_INCLUDE_
+
+/* 16ビット・タイマ(φ/8 = 2.5MHzでカウント) */
+#define TIMER_COUNT_PER_MSEC	2500
+#define TIMER_MSEC_MAX		26 /* 16ビットで表せる最大の周期 */
+
+int timer_start(int index,int msec);          /* 周期タイマ開始 */
+int timer_start_free(int index);              /* フリーラン・カウンタ開始 */
+int timer_is_expired(int index);              /* コンペア・マッチ発生か？ */
+void timer_expire(int index);                 /* コンペア・マッチのクリア */
+void timer_cancel(int index);                 /* タイマ停止 */
+
+uint16 timer_get_count(int index);            /* カウンタの読み出し */
+void timer_set_count(int index,uint16 count); /* カウンタの設定 */
+void timer_set_period(int index,uint16 count);/* 周期(カウント数)の変更 */
+
+#endif